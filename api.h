@@ -14,9 +14,14 @@
 #pragma once
 
 #include <functional>
+#include <unordered_set>
+#include <vector>
 #include <imtjson/json.h>
 
-#define INTERFACE_VERSION "1.0.5"
+#define INTERFACE_VERSION "1.0.9"
+
+///Marks classes exported from the library couchcpp_runtime
+#define COUCHCPP_API __attribute__ ((visibility ("default")))
 
 using namespace json;
 
@@ -25,7 +30,31 @@ using namespace json;
 
 
 
-class Document: public json::Value {
+template<std::size_t N> class FieldPath;
+
+///Calculates length of base64 representation of the binary data of given size (including padding)
+inline std::size_t base64EncodedSize(std::size_t sz) {return (sz + 2) / 3 * 4;}
+///Calculates size of buffer large enough to hold decoded base64 text
+inline std::size_t base64DecodedSize(StrViewA text) {return (text.length + 3) / 4 * 3;}
+///Encodes binary data to base64
+/**
+ * @param data data to encode
+ * @param out output buffer, it must have at least base64EncodedSize() characters
+ */
+COUCHCPP_API void base64Encode(BinaryView data, char *out);
+///Encodes binary data to base64 string
+COUCHCPP_API String base64Encode(BinaryView data);
+///Decodes base64 text
+/**
+ * @param text text to decode. Padding is optional
+ * @param out output buffer, it must have at least base64DecodedSize() bytes
+ * @return count of decoded bytes
+ * @exception std::runtime_error invalid base64 string (a character outside of the alphabet,
+ * incomplete last group, non-zero unused bits or wrong count of padding characters)
+ */
+COUCHCPP_API std::size_t base64Decode(StrViewA text, unsigned char *out);
+
+class COUCHCPP_API Document: public json::Value {
 public:
 	Document(const json::Value &x):json::Value(x) {}
 
@@ -40,12 +69,7 @@ public:
 	 * @param typeSep separator between type and rest of id
 	 * @return document type. if separator missing, returns empty string
 	 */
-	StrViewA getDocType(char typeSep = '.') const {
-		StrViewA id = getID();
-		std::size_t seppos = id.indexOf(StrViewA(&typeSep,1));
-		if (seppos == id.npos) return StrViewA();
-		else return id.substr(0,seppos);
-	}
+	StrViewA getDocType(char typeSep = '.') const;
 
 	///Replaces value in the document specified by the path. Returns updated document
 	/**
@@ -55,9 +79,7 @@ public:
 	 *
 	 * @note for multiple changes, it is better to use json::Object
 	 */
-	Document replace(const Path &path, const json::Value &val) const {
-		return Document(json::Value::replace(path,val));
-	}
+	Document replace(const Path &path, const json::Value &val) const;
 	///Replaces value in the document specified by the a key (at first level). Returns updated document
 	/**
 	 * @param key to replace
@@ -66,9 +88,15 @@ public:
 	 *
 	 * @note for multiple changes, it is better to use json::Object
 	 */
-	Document replace(const StrViewA &key, const json::Value &val) const {
-		return Document(json::Value::replace(json::Path::root/key,val));
-	}
+	Document replace(const StrViewA &key, const json::Value &val) const;
+
+	///Retrieves nested field using the path
+	/**
+	 * @param path path created by the function field()
+	 * @return value of the field or undefined, if the field doesn't exist
+	 */
+	template<std::size_t N>
+	Value get(const FieldPath<N> &path) const;
 
 	///Retrieve metadata about specified attachment
 	Value getAttachment(StrViewA name) const {
@@ -79,18 +107,7 @@ public:
 		return (*this)["_attachments"];
 	}
 	///calculates uru (relative to database root) for specified attachment
-	String getAttachmentUri(StrViewA name, Value userContext) const {
-		Value db = userContext["db"];
-		if (!db.defined()) {
-			db = userContext["userCtx"]["db"];
-		}
-		if (!db.defined()) {
-			throw std::runtime_error("getAttachmentUri - invalid 2. argument");
-		}
-		Value idenc = urlEncoding->encodeBinaryValue(BinaryView(getID()));
-		Value nameenc = urlEncoding->encodeBinaryValue(BinaryView(name));
-		return String({db.getString(),"/",idenc,"/",nameenc});
-	}
+	String getAttachmentUri(StrViewA name, Value userContext) const;
 	///Sets attachment
 	/**
 	 * @param name name of attachment
@@ -100,18 +117,214 @@ public:
 	 *
 	 * @note function replaces existing attachment.
 	 */
-	Document setAttachment(StrViewA name, Value data) {
-		return replace(Path::root/"_attachments"/name, data);
+	Document setAttachment(StrViewA name, Value data);
+	///Retrieves content of an inline attachment
+	/**
+	 * The data are decoded directly into the buffer, so the buffer can be reused for
+	 * multiple attachments without allocation
+	 *
+	 * @param name name of attachment
+	 * @param buffer buffer which receives the decoded content.
+	 * @return view to the decoded content inside of the buffer. It returns empty view, if
+	 * the attachment doesn't exist or it is a stub (without data)
+	 */
+	BinaryView getAttachmentData(StrViewA name, std::vector<unsigned char> &buffer) const;
+	///Sets inline attachment
+	/**
+	 * @param name name of attachment
+	 * @param contentType content type of the attachment
+	 * @param data content of the attachment. It is encoded directly into the document
+	 * @return new document
+	 *
+	 * @note function replaces existing attachment.
+	 */
+	Document setAttachmentData(StrViewA name, StrViewA contentType, BinaryView data) const;
+
+};
+
+
+
+///Named path to a nested field of the document
+/**
+ * The path keeps the keys as string views and the lookup walks the document the same way
+ * as doc["a"]["b"]["c"] does, so it is not faster (compare field_path and field_chained in
+ * couchcpp_microbench). It is a convenience: the path can be declared once as a member,
+ * passed to DocumentEdit::set() and unset(), and the lookup returns undefined, when a value
+ * on the path is not an object.
+ *
+ * @code
+ * class Proc {
+ *    FieldPath<3> city = field("address","location","city");
+ *
+ *    void mapdoc(Document doc) {
+ *        Value c = doc.get(city);
+ *        if (c.defined()) emit(c);
+ *    }
+ * };
+ * @endcode
+ *
+ * Keys must be string literals or strings, which live longer than the path
+ */
+template<std::size_t N>
+class FieldPath {
+public:
+	template<typename... Keys>
+	FieldPath(Keys... keys):keys{StrViewA(keys)...} {
+		static_assert(sizeof...(Keys) == N, "Count of keys doesn't match to the length of the path");
+	}
+
+	///Retrieves the field, returns undefined, if the field doesn't exist
+	Value operator()(const Value &doc) const {
+		Value v = doc;
+		for (const StrViewA &k: keys) {
+			if (v.type() != json::object) return Value();
+			v = v[k];
+		}
+		return v;
 	}
+	///Returns true, if the field exists
+	bool exists(const Value &doc) const {
+		return operator()(doc).defined();
+	}
+	///Returns keys of the path
+	const StrViewA *getKeys() const {return keys;}
 
+protected:
+	StrViewA keys[N];
 };
 
+///Creates path to a nested field
+/**
+ * @param keys keys of the path from the root of the document
+ * @return path object
+ */
+template<typename... Keys>
+FieldPath<sizeof...(Keys)> field(Keys... keys) {
+	return FieldPath<sizeof...(Keys)>(keys...);
+}
+
+template<std::size_t N>
+Value Document::get(const FieldPath<N> &path) const {
+	return path(*this);
+}
+
+///Accumulates changes of the document and applies them at once
+/**
+ * Every call of Document::replace() creates new copy of the path to the changed field. The
+ * object DocumentEdit collects the changes, including changes of nested fields, and the
+ * function commit() builds the new document in single pass.
+ *
+ * @code
+ * void update(Document &doc, Value req) {
+ *     DocumentEdit edit(doc);
+ *     edit.set("status", "done")
+ *         .set(field("stats","count"), doc.get(field("stats","count")).getUInt() + 1)
+ *         .unset("lock");
+ *     edit.commit();
+ * }
+ * @endcode
+ *
+ * Setting a value equal to the current value is not recorded. If there are no changes, commit()
+ * keeps the document untouched, so the server doesn't store a new revision.
+ *
+ * @note changes are not applied without calling commit()
+ */
+class COUCHCPP_API DocumentEdit {
+public:
+	///Starts editing of the document
+	/**
+	 * @param doc document to edit. The document is replaced by commit()
+	 */
+	explicit DocumentEdit(Document &doc):doc(doc) {}
+
+	///Sets the field at the first level
+	DocumentEdit &set(StrViewA key, const Value &val) {return set(&key, 1, val);}
+	///Sets the nested field. Missing objects on the path are created
+	template<std::size_t N>
+	DocumentEdit &set(const FieldPath<N> &path, const Value &val) {return set(path.getKeys(), N, val);}
+	///Removes the field at the first level
+	DocumentEdit &unset(StrViewA key) {return set(&key, 1, Value());}
+	///Removes the nested field. Values on the path, which are not objects, are kept untouched
+	template<std::size_t N>
+	DocumentEdit &unset(const FieldPath<N> &path) {return set(path.getKeys(), N, Value());}
+
+	///Returns true, if there are changes to commit
+	bool changed() const {return !edits.empty();}
+	///Returns true, if the field at the first level (or a field nested in it) is changed
+	bool changed(StrViewA key) const;
+
+	///Applies all changes to the document
+	/**
+	 * @return the updated document
+	 */
+	Document &commit();
+	///Discards all changes
+	void revert() {edits.clear();}
+
+	///Single change - path to the field and new value (undefined to remove the field)
+	struct Edit {
+		std::vector<String> path;
+		Value value;
+	};
+
+protected:
+	Document &doc;
+	std::vector<Edit> edits;
 
+	DocumentEdit &set(const StrViewA *keys, std::size_t count, const Value &val);
+};
 
 typedef json::Value Key;
 
+///Hash function for string views (FNV-1a), allows to use StrViewA in hash containers
+struct StrViewHash {
+	std::size_t operator()(const StrViewA &str) const {
+		std::size_t h = 2166136261U;
+		for (char c: str) h = (h ^ (unsigned char)c) * 16777619U;
+		return h;
+	}
+};
+
+///Set of strings. Strings are not copied, they must be kept by an other object
+typedef std::unordered_set<StrViewA, StrViewHash> StrViewSet;
+
+///Names and roles of a section of the security object ("admins" or "members")
+struct COUCHCPP_API NameRoleSet {
+	StrViewSet names;
+	StrViewSet roles;
+
+	NameRoleSet(Value section);
+	///Returns true, if the section is empty
+	bool empty() const {return names.empty() && roles.empty();}
+};
+
+///Pre-built index of the security object
+/** The index is built once and reused while the security object doesn't change */
+class COUCHCPP_API SecurityIndex: public RefCntObj {
+public:
+	SecurityIndex(Value security);
+
+	///Indexed security object
+	const Value security;
+	const NameRoleSet admins;
+	const NameRoleSet members;
+};
+
+///Pre-built index of the user context
+class COUCHCPP_API UserIndex: public RefCntObj {
+public:
+	UserIndex(Value user);
+
+	///Indexed user context
+	const Value user;
+	///Name of the user
+	const StrViewA name;
+	///Roles of the user
+	const StrViewSet roles;
+};
+
 ///Contains context of the validation
-struct ContextData {
+struct COUCHCPP_API ContextData {
 	///Previous document. Can be null for first document
 	Document prevDoc;
 	///User which updates the document
@@ -119,7 +332,31 @@ struct ContextData {
 	///security informations
 	Value security;
 
-	ContextData(Document prevDoc,Value user,Value security):prevDoc(prevDoc),user(user),security(security) {}
+	ContextData(Document prevDoc,Value user,Value security);
+	ContextData(Document prevDoc,RefCntPtr<const UserIndex> userIndex, RefCntPtr<const SecurityIndex> securityIndex);
+
+	///Returns true, if the user has the role
+	bool hasRole(StrViewA role) const;
+	///Returns true, if the user is admin of the database
+	/**
+	 * The user is admin, if the user is a server admin (role "_admin"), or the user's name or any
+	 * of the user's roles is listed in the section "admins" of the security object
+	 */
+	bool isAdmin() const;
+	///Returns true, if the user is member of the database
+	/**
+	 * The user is member, if the user is admin, or the user's name or any of the user's roles is
+	 * listed in the section "members" of the security object.
+	 *
+	 * @note function returns false for an empty section "members", even if CouchDB treats such database as public
+	 */
+	bool isMember() const;
+
+protected:
+	RefCntPtr<const UserIndex> userIndex;
+	RefCntPtr<const SecurityIndex> securityIndex;
+
+	static bool anyRole(const StrViewSet &userRoles, const NameRoleSet &section);
 };
 
 
@@ -263,6 +500,15 @@ public:
 
 typedef const ContextData &Context;
 
+///Level of the message sent to the log
+/** Messages below the level configured in couchcpp.conf are discarded */
+enum LogLevel {
+	logDebug,
+	logInfo,
+	logWarning,
+	logError
+};
+
 
 #ifndef __COUCHCPP_COMPILER
 
@@ -293,6 +539,12 @@ void emit();
  * @param msg message which appears in log
  */
 void log(StrViewA msg);
+///Send text to the log with given level
+/**
+ * @param level level of the message
+ * @param msg message which appears in log
+ */
+void log(LogLevel level, StrViewA msg);
 ///Send message and object to the log
 /**
  * @param msg message which appears in log
@@ -346,6 +598,20 @@ void send(StrViewA str);
  * @param json json to send
  */
 void sendJSON(const json::Value json);
+///Send binary data to the output
+/**
+ * The body of the response is transferred as base64. Available in show() and update()
+ *
+ * @param data data to send
+ */
+void sendBinary(BinaryView data);
+///Sets already built JSON value as the body of the response
+/**
+ * The value is passed to the server without serialization to text. Available in show() and update()
+ *
+ * @param body body of the response
+ */
+void setJSONBody(const json::Value body);
 
 
 
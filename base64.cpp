@@ -0,0 +1,268 @@
+/*
+ * base64.cpp
+ *
+ * Base64 codec of the runtime. Blocks of 12 bytes (16 characters) are processed by SSSE3,
+ * blocks of 24 bytes (32 characters) by AVX2. The implementation is selected by the CPU
+ * at startup; the scalar code handles the tails and the other architectures.
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "base64.h"
+
+static const char encodeTable[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+///Encodes the rest of data (scalar)
+void base64EncodeScalar(const unsigned char *data, std::size_t len, char *out) {
+	std::size_t i = 0;
+	for (; i + 3 <= len; i += 3) {
+		unsigned int v = (data[i] << 16) | (data[i+1] << 8) | data[i+2];
+		*out++ = encodeTable[v >> 18];
+		*out++ = encodeTable[(v >> 12) & 0x3F];
+		*out++ = encodeTable[(v >> 6) & 0x3F];
+		*out++ = encodeTable[v & 0x3F];
+	}
+	if (i + 1 == len) {
+		unsigned int v = data[i] << 16;
+		*out++ = encodeTable[v >> 18];
+		*out++ = encodeTable[(v >> 12) & 0x3F];
+		*out++ = '=';
+		*out++ = '=';
+	} else if (i + 2 == len) {
+		unsigned int v = (data[i] << 16) | (data[i+1] << 8);
+		*out++ = encodeTable[v >> 18];
+		*out++ = encodeTable[(v >> 12) & 0x3F];
+		*out++ = encodeTable[(v >> 6) & 0x3F];
+		*out++ = '=';
+	}
+}
+
+static int decodeChar(unsigned char c) {
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == '/') return 63;
+	return -1;
+}
+
+static void invalidBase64() {
+	throw std::runtime_error("Invalid base64 string");
+}
+
+///Decodes the rest of text (scalar)
+std::size_t base64DecodeScalar(const unsigned char *text, std::size_t len, unsigned char *out) {
+	unsigned char *beg = out;
+	unsigned int acc = 0;
+	unsigned int bits = 0;
+	std::size_t i = 0;
+	for (; i < len && text[i] != '='; i++) {
+		int v = decodeChar(text[i]);
+		if (v < 0) invalidBase64();
+		acc = (acc << 6) | v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			*out++ = (unsigned char)(acc >> bits);
+		}
+	}
+	std::size_t chars = i;
+	for (; i < len; i++) if (text[i] != '=') invalidBase64();
+	std::size_t padding = len - chars;
+	//single character of the last group can't carry a byte, the unused bits must be zero
+	if (chars % 4 == 1 || (acc & ((1U << bits) - 1)) != 0) invalidBase64();
+	//padding is optional, but when present, it must complete the last group
+	if (padding && (chars % 4 == 0 || chars % 4 + padding != 4)) invalidBase64();
+	return out - beg;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+//Reshuffle and lookup: W. Mula, D. Lemire, Faster Base64 Encoding and Decoding Using AVX2 Instructions
+
+__attribute__((target("ssse3")))
+static inline __m128i encodeBlock(__m128i in) {
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	__m128i idx = _mm_or_si128(t1, t3);
+	//0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+	__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+	const __m128i shiftLUT = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm_add_epi8(_mm_shuffle_epi8(shiftLUT, r), idx);
+}
+
+///Translates 16 characters to 6-bit values
+/**
+ * @param valid receives false, if the block contains a character, which is not part of the alphabet
+ */
+__attribute__((target("ssse3")))
+static inline __m128i decodeValues(__m128i c, bool &valid) {
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+	__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), c));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+	__m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+	__m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+	__m128i ok = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+	valid = _mm_movemask_epi8(ok) == 0xFFFF;
+	__m128i shift = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')), _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+			_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+					_mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')), _mm_and_si128(slash, _mm_set1_epi8(63 - '/')))));
+	return _mm_add_epi8(c, shift);
+}
+
+///Packs 16 6-bit values into 12 bytes (the last 4 bytes are zero)
+__attribute__((target("ssse3")))
+static inline __m128i packValues(__m128i v) {
+	__m128i ab = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	__m128i abc = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(abc, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+void base64EncodeSSSE3(const unsigned char *data, std::size_t len, char *out) {
+	std::size_t i = 0;
+	for (; i + 16 <= len; i += 12) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), encodeBlock(in));
+		out += 16;
+	}
+	base64EncodeScalar(data + i, len - i, out);
+}
+
+__attribute__((target("ssse3")))
+std::size_t base64DecodeSSSE3(const unsigned char *text, std::size_t len, unsigned char *out) {
+	unsigned char *beg = out;
+	std::size_t i = 0;
+	//the block writes 16 bytes, but only 12 are valid. Keep the space for the padding
+	for (; i + 32 <= len; i += 16) {
+		bool valid;
+		__m128i v = decodeValues(_mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i)), valid);
+		if (!valid) break;
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), packValues(v));
+		out += 12;
+	}
+	return (out - beg) + base64DecodeScalar(text + i, len - i, out);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i encodeBlock(__m256i in) {
+	in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+	__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+	__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+	__m256i idx = _mm256_or_si256(t1, t3);
+	__m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+	__m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+	r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+	const __m256i shiftLUT = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(shiftLUT, r), idx);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i decodeValues(__m256i c, bool &valid) {
+	__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+	__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+	__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+	__m256i plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+	__m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+	__m256i ok = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+	valid = (unsigned int)_mm256_movemask_epi8(ok) == 0xFFFFFFFFU;
+	__m256i shift = _mm256_or_si256(
+			_mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')), _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+			_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+					_mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')), _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')))));
+	return _mm256_add_epi8(c, shift);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i packValues(__m256i v) {
+	__m256i ab = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+	__m256i abc = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+	return _mm256_shuffle_epi8(abc, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("avx2")))
+void base64EncodeAVX2(const unsigned char *data, std::size_t len, char *out) {
+	std::size_t i = 0;
+	for (; i + 28 <= len; i += 24) {
+		//each lane encodes 12 bytes
+		__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 12));
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), encodeBlock(in));
+		out += 32;
+	}
+	base64EncodeSSSE3(data + i, len - i, out);
+}
+
+__attribute__((target("avx2")))
+std::size_t base64DecodeAVX2(const unsigned char *text, std::size_t len, unsigned char *out) {
+	unsigned char *beg = out;
+	std::size_t i = 0;
+	for (; i + 48 <= len; i += 32) {
+		bool valid;
+		__m256i v = decodeValues(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i)), valid);
+		if (!valid) break;
+		__m256i p = packValues(v);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(p));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 12), _mm256_extracti128_si256(p, 1));
+		out += 24;
+	}
+	return (out - beg) + base64DecodeSSSE3(text + i, len - i, out);
+}
+
+#endif
+
+static Base64EncodeFn selectEncode() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return &base64EncodeAVX2;
+	if (__builtin_cpu_supports("ssse3")) return &base64EncodeSSSE3;
+#endif
+	return &base64EncodeScalar;
+}
+
+static Base64DecodeFn selectDecode() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return &base64DecodeAVX2;
+	if (__builtin_cpu_supports("ssse3")) return &base64DecodeSSSE3;
+#endif
+	return &base64DecodeScalar;
+}
+
+static const Base64EncodeFn encodeImpl = selectEncode();
+static const Base64DecodeFn decodeImpl = selectDecode();
+
+void base64Encode(BinaryView data, char *out) {
+	encodeImpl(data.data, data.length, out);
+}
+
+std::size_t base64Decode(StrViewA text, unsigned char *out) {
+	return decodeImpl(reinterpret_cast<const unsigned char *>(text.data), text.length, out);
+}
+
+String base64Encode(BinaryView data) {
+	return String(base64EncodedSize(data.length), [&](char *buff) {
+		base64Encode(data, buff);
+		return base64EncodedSize(data.length);
+	});
+}
@@ -0,0 +1,40 @@
+/*
+ * base64.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include "parts/common.h"
+
+#define COUCHCPP_BASE64_API __attribute__ ((visibility ("default")))
+
+///Encodes binary data to base64 (including padding)
+/**
+ * @param data data to encode
+ * @param len length of the data
+ * @param out output buffer, it must have at least base64EncodedSize() characters
+ */
+typedef void (*Base64EncodeFn)(const unsigned char *data, std::size_t len, char *out);
+///Decodes base64 text
+/**
+ * @param text text to decode
+ * @param len length of the text
+ * @param out output buffer, it must have at least base64DecodedSize() bytes
+ * @return count of decoded bytes
+ * @exception std::runtime_error invalid base64 text
+ */
+typedef std::size_t (*Base64DecodeFn)(const unsigned char *text, std::size_t len, unsigned char *out);
+
+///Scalar codec (processes 3 bytes at once)
+COUCHCPP_BASE64_API void base64EncodeScalar(const unsigned char *data, std::size_t len, char *out);
+COUCHCPP_BASE64_API std::size_t base64DecodeScalar(const unsigned char *text, std::size_t len, unsigned char *out);
+#if defined(__x86_64__) || defined(__i386__)
+///SSSE3 codec (processes 12 bytes at once), requires CPU with SSSE3
+COUCHCPP_BASE64_API void base64EncodeSSSE3(const unsigned char *data, std::size_t len, char *out);
+COUCHCPP_BASE64_API std::size_t base64DecodeSSSE3(const unsigned char *text, std::size_t len, unsigned char *out);
+///AVX2 codec (processes 24 bytes at once), requires CPU with AVX2
+COUCHCPP_BASE64_API void base64EncodeAVX2(const unsigned char *data, std::size_t len, char *out);
+COUCHCPP_BASE64_API std::size_t base64DecodeAVX2(const unsigned char *text, std::size_t len, unsigned char *out);
+#endif
@@ -0,0 +1,124 @@
+/*
+ * escape_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include "../jsonwriter.h"
+
+using namespace json;
+
+///Compares serialization of documents by Value::stringify() and writeJSON()
+/**
+ * Usage: couchcpp_escape_bench [iterations]
+ *
+ * The documents are generated (mostly ASCII text, some escapes and UTF-8 characters). The
+ * result is printed as JSON object. The tool fails, when the output of any implementation
+ * differs from Value::stringify()
+ */
+
+static std::string writeJSONToString(const Value &v) {
+	std::string out;
+	writeJSON(v, out);
+	return out;
+}
+
+template<typename Fn>
+static double measure(unsigned int iterations, Fn &&fn) {
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < iterations; i++) fn();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static std::string generateText(std::mt19937 &rnd, std::size_t len) {
+	static const char *words[] = {"lorem","ipsum","dolor","sit","amet","consectetur","adipiscing","elit",
+			"\xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd","k\xc5\xaf\xc5\x88","\"quoted\"","line\n","tab\t","path\\to"};
+	std::string out;
+	while (out.length() < len) {
+		out.append(words[rnd() % 8 + (rnd() % 10 == 0?6:0)]);
+		out.push_back(' ');
+	}
+	return out;
+}
+
+int main(int argc, char **argv) {
+	unsigned int iterations = argc > 1?std::strtoul(argv[1], nullptr, 10):1000;
+	std::mt19937 rnd(1);
+
+	Array docs;
+	for (int i = 0; i < 100; i++) {
+		docs.push_back(Object
+				("_id", generateText(rnd, 10))
+				("_rev", "1-0123456789abcdef")
+				("title", generateText(rnd, 50))
+				("body", generateText(rnd, 2000))
+				("count", i)
+				("tags", {generateText(rnd, 8), generateText(rnd, 8)}));
+	}
+	Value batch(docs);
+	std::size_t bytes = batch.stringify().length();
+	if (batch.stringify() != StrViewA(writeJSONToString(batch))) {
+		std::cerr << "writeJSON: the output differs from stringify()" << std::endl;
+		return 1;
+	}
+
+	double stringify = measure(iterations, [&] {
+		batch.stringify();
+	});
+	std::string buff;
+	double writer = measure(iterations, [&] {
+		buff.clear();
+		writeJSON(batch, buff);
+	});
+
+	std::string text = generateText(rnd, 1<<20);
+	Object escape;
+	std::vector<std::pair<StrViewA, EscapeFn> > fns;
+	fns.push_back(std::make_pair(StrViewA("scalar"), &escapeStringScalar));
+#if defined(__x86_64__) || defined(__i386__)
+	fns.push_back(std::make_pair(StrViewA("sse2"), &escapeStringSSE2));
+	if (__builtin_cpu_supports("avx2"))
+		fns.push_back(std::make_pair(StrViewA("avx2"), &escapeStringAVX2));
+#endif
+	//every implementation must produce the same output as stringify(), including long runs of non-ASCII text
+	std::string national;
+	while (national.length() < 4096) national.append("\xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88 \xc3\xbap\xc4\x9bl \"\xc4\x8f\xc3\xa1" "belsk\xc3\xa9\" \xc3\xb3" "dy\n");
+	for (auto &&fn: fns) {
+		for (const std::string &t: {text, national, generateText(rnd, 100)}) {
+			std::string esc("\"");
+			fn.second(t, esc);
+			esc.push_back('"');
+			if (Value(t).stringify() != StrViewA(esc)) {
+				std::cerr << "escape " << fn.first << ": the output differs from stringify()" << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	unsigned int textIterations = iterations / 10 + 1;
+	for (auto &&fn: fns) {
+		double t = measure(textIterations, [&] {
+			buff.clear();
+			fn.second(text, buff);
+		});
+		escape.set(fn.first, (double)text.length() * textIterations / (1024.0*1024.0) * 1000.0 / t);
+	}
+
+	double mb = (double)bytes * iterations / (1024.0*1024.0);
+	Value result = Object
+			("bytes", bytes)
+			("iterations", iterations)
+			("stringify_ms", stringify)
+			("stringify_MBps", mb * 1000.0 / stringify)
+			("writeJSON_ms", writer)
+			("writeJSON_MBps", mb * 1000.0 / writer)
+			("escape_MBps", escape);
+	result.toStream(std::cout);
+	std::cout << std::endl;
+	return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * microbench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "../jsonstream.h"
+#include "../module.h"
+#include "../textbuffer.h"
+
+///Measures the building blocks of the query server in isolation
+/**
+ * Usage: couchcpp_microbench [filter] [scale]
+ *
+ * filter - runs only benchmarks, which names contain the text
+ * scale - multiplies count of iterations (default 1)
+ *
+ * The result is printed as JSON array, one object per benchmark
+ */
+
+///Discards the output
+class NullBuf: public std::streambuf {
+protected:
+	virtual int_type overflow(int_type c) override {return traits_type::not_eof(c);}
+	virtual std::streamsize xsputn(const char *, std::streamsize n) override {return n;}
+};
+
+///Map function calling emit through the AbstractProc
+class EmitProc: public AbstractProc {
+public:
+	virtual void mapdoc(Document doc) override {
+		emit(doc.getID(), doc["count"]);
+		emit({doc.getDocType(), doc["title"]});
+	}
+};
+
+///Prevents the compiler to optimize out the result
+static volatile std::size_t sink;
+
+static Array results;
+static StrViewA filter;
+static unsigned int scale = 1;
+
+///Runs the benchmark
+/**
+ * @param name name of the benchmark
+ * @param iterations count of iterations
+ * @param ops count of operations per iteration (the result is per operation)
+ * @param fn function to measure
+ */
+template<typename Fn>
+static void bench(const char *name, unsigned int iterations, std::size_t ops, Fn &&fn) {
+	if (!filter.empty() && StrViewA(name).indexOf(filter) == StrViewA::npos) return;
+	iterations *= scale;
+	fn(); //warm up
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < iterations; i++) fn();
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - start).count();
+	results.push_back(Object
+			("name", name)
+			("iterations", iterations)
+			("ops", ops)
+			("ns_per_op", ns / ((double)iterations * ops)));
+	std::cerr << name << ": " << ns / ((double)iterations * ops) << " ns/op" << std::endl;
+}
+
+static Value makeDoc(unsigned int i) {
+	return Object
+			("_id", String({"user.", Value(i*7919).toString()}))
+			("_rev", "1-967a00dff5e02add41819138abb3284d")
+			("title", String({"Document number ", Value(i).toString()}))
+			("count", i)
+			("tags", {"alpha","beta","gamma"})
+			("address", Object("city","Prague")("zip","11000")("street","Na Prikope 1"));
+}
+
+static Value makeRows(unsigned int count) {
+	Array rows;
+	for (unsigned int i = 0; i < count; i++) {
+		rows.push_back({{Value({"key", i % 17}), String({"doc", Value(i).toString()})}, i});
+	}
+	return rows;
+}
+
+static const char *sampleCode =
+		"//!link -lm\n"
+		"#include <cmath>\n"
+		"\n"
+		"class Fn: public AbstractProc {\n"
+		"public:\n"
+		"\tvirtual void mapdoc(Document doc) override {\n"
+		"\t\tif (doc[\"type\"].getString() == \"user\") {\n"
+		"\t\t\temit(doc[\"name\"], std::sqrt(doc[\"score\"].getNumber()));\n"
+		"\t\t}\n"
+		"\t}\n"
+		"};\n";
+
+int main(int argc, char **argv) {
+	if (argc > 1) filter = argv[1];
+	if (argc > 2) scale = std::strtoul(argv[2], nullptr, 10);
+	if (scale == 0) scale = 1;
+	logger.setLevel(logError);
+
+	Value rows = makeRows(1000);
+	bench("rowset_iterate", 1000, 1000, [&] {
+		std::size_t s = 0;
+		for (Row r: RowSet(rows)) s += r.docId.length + r.value.getUInt();
+		sink = s;
+	});
+	bench("rowset_index", 1000, 1000, [&] {
+		RowSet rs(rows);
+		std::size_t s = 0;
+		for (int i = 0; i < 1000; i++) s += rs[i].key.size();
+		sink = s;
+	});
+
+	Document doc(makeDoc(42));
+	bench("document_getID", 100000, 1, [&] {
+		sink = doc.getID().length;
+	});
+	bench("document_getDocType", 100000, 1, [&] {
+		sink = doc.getDocType().length;
+	});
+	bench("document_replace", 100000, 1, [&] {
+		sink = doc.replace("count", 43).size();
+	});
+
+	//FieldPath against the same lookup written as chained operator[]
+	FieldPath<2> city = field("address","city");
+	bench("field_path", 100000, 1, [&] {
+		sink = doc.get(city).getString().length;
+	});
+	bench("field_chained", 100000, 1, [&] {
+		sink = doc["address"]["city"].getString().length;
+	});
+
+	bench("document_edit", 100000, 1, [&] {
+		Document d(doc);
+		DocumentEdit edit(d);
+		edit.set("count", 43).set(field("stats","views"), 1).unset(field("count","old"));
+		sink = edit.commit().size();
+	});
+
+	std::vector<unsigned char> attdata(65536);
+	for (std::size_t i = 0; i < attdata.size(); i++) attdata[i] = (unsigned char)(i * 2654435761U >> 24);
+	Document attdoc = doc.setAttachmentData("blob", "application/octet-stream", BinaryView(attdata.data(), attdata.size()));
+	bench("attachment_encode", 1000, attdata.size(), [&] {
+		sink = doc.setAttachmentData("blob", "application/octet-stream", BinaryView(attdata.data(), attdata.size())).size();
+	});
+	std::vector<unsigned char> attbuff;
+	bench("attachment_decode", 1000, attdata.size(), [&] {
+		sink = attdoc.getAttachmentData("blob", attbuff).length;
+	});
+
+	std::vector<Value> docs;
+	for (unsigned int i = 0; i < 100; i++) docs.push_back(makeDoc(i));
+	EmitProc proc;
+	Array out;
+	proc.initEmit([&](const Value &key, const Value &value) {
+		out.add({key.defined()?key:Value(nullptr), value.defined()?value:Value(nullptr)});
+	});
+	bench("emit", 1000, 200, [&] {
+		for (const Value &d: docs) proc.mapdoc(d);
+		sink = out.size();
+		out.clear();
+	});
+
+	TextBuffer tbuff;
+	std::string chunk(64, 'x');
+	bench("textbuffer_push_back", 1000, 1000, [&] {
+		tbuff.clear();
+		for (int i = 0; i < 1000; i++) tbuff.push_back(StrViewA(chunk));
+	});
+
+	bench("createSource", 10000, 1, [&] {
+		sink = ModuleCompiler::createSource(sampleCode, "code_fragment").sourceCode.length();
+	});
+
+	ModuleCompiler compiler("/tmp", "/usr/bin/g++", "-fPIC -shared -O2 -std=c++11", "", false);
+	bench("calcHash", 10000, 1, [&] {
+		sink = compiler.calcHash(sampleCode);
+	});
+
+	std::string input;
+	for (const Value &d: docs) {
+		input.append(Value({"map_doc", d}).stringify().c_str());
+		input.push_back('\n');
+	}
+	bench("jsonstream_read", 100, 100, [&] {
+		std::istringstream in(input);
+		NullBuf nb;
+		std::ostream out(&nb);
+		JSONStream stream(in, out);
+		while (!stream.isEof()) stream.read();
+	});
+
+	Value response = {Value(json::array,{Value({"key", "value"}), Value({doc.getID(), doc})})};
+	bench("jsonstream_write", 100, 100, [&] {
+		std::istringstream in;
+		NullBuf nb;
+		std::ostream out(&nb);
+		JSONStream stream(in, out);
+		for (int i = 0; i < 100; i++) stream.write(response);
+	});
+
+	Value(results).toStream(std::cout);
+	std::cout << std::endl;
+	return 0;
+}
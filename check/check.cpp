@@ -0,0 +1,202 @@
+/*
+ * check.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../base64.h"
+#include "../launcher.h"
+#include "../logger.h"
+#include "../module.h"
+#include "../schema.h"
+
+///Checks behaviour of the parts of the query server
+/**
+ * Usage: couchcpp_check [filter]
+ *
+ * filter - runs only checks, which names contain the text
+ *
+ * Failed checks are printed to the standard error. The exit code is zero, when all checks pass
+ *
+ * The checks, which compile user code, need the compiler and the headers of imtjson. The
+ * headers of couchcpp and the runtime library are taken from the source and the build directory
+ */
+
+static StrViewA filter;
+static unsigned int failed = 0;
+
+///Reports the failed condition
+static void expect(bool cond, const char *name, const std::string &what) {
+	if (!cond) {
+		std::cerr << name << ": FAILED " << what << std::endl;
+		failed++;
+	}
+}
+
+///Runs the check, an exception counts as a failure
+template<typename Fn>
+static void check(const char *name, Fn &&fn) {
+	if (!filter.empty() && StrViewA(name).indexOf(filter) == StrViewA::npos) return;
+	try {
+		fn(name);
+	} catch (std::exception &e) {
+		std::cerr << name << ": FAILED " << e.what() << std::endl;
+		failed++;
+		return;
+	}
+	std::cerr << name << ": ok" << std::endl;
+}
+
+///Creates the cache for compiled modules with the headers of couchcpp
+static String prepareCache() {
+	char tmpl[] = "/tmp/couchcpp_check.XXXXXX";
+	if (mkdtemp(tmpl) == nullptr) throw std::runtime_error("Unable to create temporary directory");
+	String cache(tmpl);
+	String inc({cache,"/include"});
+	mkdir(inc.c_str(), 0777);
+	if (symlink(COUCHCPP_SOURCE_DIR, String({inc,"/couchcpp"}).c_str()) != 0)
+		throw std::runtime_error("Unable to link the headers");
+	return cache;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1) filter = argv[1];
+	logger.setLevel(logError);
+
+	String cache = prepareCache();
+	ModuleCompiler compiler(cache, "/usr/bin/g++",
+			String({"-fPIC -shared -std=c++11 -fvisibility=hidden -I", cache, "/include"}),
+			String({"-L", COUCHCPP_RUNTIME_DIR, " -lcouchcpp_runtime"}), false);
+
+	check("selector_filter", [&](const char *name) {
+		PModule m = compiler.compile(
+				"//!selector {\"type\":\"user\",\"age\":{\"$gte\":18},\"tags\":{\"$all\":[\"beta\"]}}");
+		IProc *p = m->getProc();
+		expect(p->filter(Document(Value::fromString(
+				"{\"_id\":\"a\",\"type\":\"user\",\"age\":20,\"tags\":[\"alpha\",\"beta\"]}")), Value()),
+				name, "matching document is rejected");
+		expect(!p->filter(Document(Value::fromString(
+				"{\"_id\":\"b\",\"type\":\"user\",\"age\":17,\"tags\":[\"beta\"]}")), Value()),
+				name, "$gte doesn't reject the document");
+		expect(!p->filter(Document(Value::fromString(
+				"{\"_id\":\"c\",\"type\":\"group\",\"age\":20,\"tags\":[\"beta\"]}")), Value()),
+				name, "equality doesn't reject the document");
+	});
+
+	check("schema_identifiers", [&](const char *name) {
+		//keys, which collide or produce keywords and reserved identifiers
+		Value schema = Value::fromString(
+				"{\"_Order\":{\"a-b\":\"string\",\"a_b\":\"number\",\"not\":\"boolean\",\"mutable\":\"any\","
+				"\"_Foo\":\"integer\",\"__x\":\"string\",\"x\":\"string\",\"decode\":\"string\","
+				"\"_document\":\"string\",\"S_Order\":\"string\",\"v\":{\"v_t\":\"string\"},\"v_t\":[{\"k\":\"number\"}]},"
+				"\"Value\":{\"static_assert\":\"string\"}}");
+		String header = generateSchemaHeader(schema);
+		String hdrPath({cache,"/check.schema.h"});
+		String srcPath({cache,"/check_schema.cpp"});
+		std::ofstream(hdrPath.c_str()) << header.c_str();
+		std::ofstream(srcPath.c_str()) << "#include <couchcpp/parts/common.h>\n#include \"check.schema.h\"\n";
+		std::string out;
+		int res = Command("/usr/bin/g++").arg("-std=c++11").arg("-fsyntax-only")
+				.arg("-I").arg(String({cache,"/include"})).arg(srcPath).run(out, 0);
+		expect(res == 0, name, "generated header doesn't compile:\n" + std::string(header.c_str()) + out);
+	});
+
+	check("document_edit", [&](const char *name) {
+		Value orig = Value::fromString("{\"_id\":\"a\",\"count\":1,\"stats\":{\"views\":2,\"likes\":3}}");
+		{
+			Document d(orig);
+			DocumentEdit edit(d);
+			edit.set(field("stats","views"), 5).set(field("address","city"), "Prague");
+			edit.commit();
+			expect(d["stats"]["views"] == Value(5) && d["stats"]["likes"] == Value(3), name, "nested set: " + std::string(d.toString().c_str()));
+			expect(d["address"]["city"] == Value("Prague"), name, "nested set doesn't create the object");
+		}
+		{
+			Document d(orig);
+			DocumentEdit edit(d);
+			edit.set(field("stats","views"), 5).set("stats", Value::fromString("{\"total\":10}"));
+			edit.commit();
+			expect(d["stats"] == Value::fromString("{\"total\":10}"), name, "set then replace parent: " + std::string(d.toString().c_str()));
+		}
+		{
+			//removing a nested field of the replaced value must not turn it into an object
+			Document d(orig);
+			DocumentEdit edit(d);
+			edit.set("count", 5).unset(field("count","old"));
+			edit.commit();
+			expect(d["count"] == Value(5), name, "unset under a non-object value: " + std::string(d.toString().c_str()));
+		}
+		{
+			Document d(orig);
+			DocumentEdit edit(d);
+			edit.unset("missing").unset(field("stats","missing"));
+			expect(!edit.changed(), name, "unset of a missing field is recorded");
+			edit.commit();
+			expect(d.isCopyOf(orig), name, "unset of a missing field changes the document");
+		}
+		{
+			Document d(orig);
+			DocumentEdit edit(d);
+			edit.set("count", 1).set(field("stats","likes"), 3);
+			edit.commit();
+			expect(d.isCopyOf(orig), name, "no-op commit doesn't keep the document");
+		}
+	});
+
+	check("base64_roundtrip", [&](const char *name) {
+		std::vector<std::pair<const char *, std::pair<Base64EncodeFn, Base64DecodeFn> > > impls;
+		impls.push_back(std::make_pair("scalar", std::make_pair(&base64EncodeScalar, &base64DecodeScalar)));
+#if defined(__x86_64__) || defined(__i386__)
+		if (__builtin_cpu_supports("ssse3"))
+			impls.push_back(std::make_pair("ssse3", std::make_pair(&base64EncodeSSSE3, &base64DecodeSSSE3)));
+		if (__builtin_cpu_supports("avx2"))
+			impls.push_back(std::make_pair("avx2", std::make_pair(&base64EncodeAVX2, &base64DecodeAVX2)));
+#endif
+		//covers the edges of the blocks (12/16 bytes SSSE3, 24/28/32/48 bytes AVX2)
+		for (std::size_t len = 0; len <= 100; len++) {
+			std::vector<unsigned char> data(len);
+			for (std::size_t i = 0; i < len; i++) data[i] = (unsigned char)(i * 2654435761U >> 24);
+			std::string ref(base64EncodedSize(len), 0);
+			base64EncodeScalar(data.data(), len, &ref[0]);
+			for (auto &&impl: impls) {
+				std::string what = std::string(impl.first) + " length " + std::to_string(len);
+				std::string enc(base64EncodedSize(len), 0);
+				impl.second.first(data.data(), len, &enc[0]);
+				expect(enc == ref, name, what + ": encoded text differs from the scalar encoder");
+				std::vector<unsigned char> dec(base64DecodedSize(StrViewA(ref)));
+				std::size_t n = impl.second.second(reinterpret_cast<const unsigned char *>(ref.data()), ref.size(), dec.data());
+				dec.resize(n);
+				expect(dec == data, name, what + ": decoded data differs from the input");
+			}
+		}
+	});
+
+	check("base64_invalid", [&](const char *name) {
+		const char *invalid[] = {"A", "AB=", "ABC==", "AB===", "=", "A===", "AB=C", "QR==", "QUJ=", "QU*D"};
+		for (const char *t: invalid) {
+			unsigned char out[16];
+			bool rejected = false;
+			try {
+				base64Decode(t, out);
+			} catch (std::exception &) {
+				rejected = true;
+			}
+			expect(rejected, name, std::string("accepted: ") + t);
+		}
+		unsigned char out[16];
+		expect(base64Decode("QUI", out) == 2 && base64Decode("QUI=", out) == 2, name, "valid text is rejected");
+	});
+
+	compiler.dropEnv();
+	std::string out;
+	Command("/bin/rm").arg("-rf").arg(cache).run(out, 0);
+	return failed?1:0;
+}
@@ -10,8 +10,19 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "module.h"
+#include "hotset.h"
+#include "jsonstream.h"
+#include "logger.h"
+#include "tracer.h"
+#include "pool.h"
+#include "reducecache.h"
+#include "textbuffer.h"
 
 
 using namespace json;
@@ -22,16 +33,55 @@ typedef std::size_t Hash;
 
 std::map<String, var> storedDocs;
 std::vector<PModule> views;
+///sources of the views (for the fused module)
+std::vector<String> viewSources;
+///all views compiled into single module (when fuseViews is enabled)
+PModule fusedViews;
+bool fuseViews = false;
+bool fusedTried = false;
+///hash of the fused module of the current views (valid when fusedTried is true)
+Hash fusedHash = 0;
+///output of the fused views, one buffer per view
+std::vector<Array> fusedOuts;
+///fused modules, which failed to compile (they are not tried again)
+std::set<Hash> fusedFailed;
 std::map<Hash, PModule> fncache;
 time_t gcrun  = 0;
+HotSet *hotset = nullptr;
+time_t pgoCollect = 0;
+ReduceCache *reduceCache = nullptr;
+Value reduceCacheStats;
+///Cache of responses of show functions marked by //!cache
+ReduceCache *showCache = nullptr;
+///Larger responses of show functions are not cached (bytes of the body)
+std::size_t showCacheMaxBody = 65536;
+Value showCacheStats;
+///Request fields declared by the show functions (by hash of the module)
+std::map<Hash, Value> showCacheFields;
+time_t maintenanceRun = 0;
+
+
+
+///Binds the log of the user function to the logger
+static void initUserLog(Module &m, std::size_t hash) {
+	m.getProc()->initLog([hash](LogLevel level, const StrViewA &msg) {
+		logger.writeUser(hash, level, msg);
+	});
+}
 
-
-
-void logOut(const StrViewA & msg) {
-	var x = {"log",String({"(couchcpp) ", msg})};
-	x.toStream(std::cout);
-	std::endl(std::cout);
-
+///Binds the log of the fused views to the logger and emit to the buffers fusedOuts
+/**
+ * It is called once, when the module is loaded. The map_doc only clears the buffers
+ */
+static void initFused(Module &m, std::size_t hash) {
+	IFusedMap *f = m.getFusedMap();
+	f->initLog([hash](LogLevel level, const StrViewA &msg) {
+		logger.writeUser(hash, level, msg);
+	});
+	if (fusedOuts.size() < f->getViewCount()) fusedOuts.resize(f->getViewCount());
+	f->initEmit([](unsigned int view, const Value &key, const Value &value) {
+		fusedOuts[view].add({key.defined()?key:Value(nullptr), value.defined()?value:Value(nullptr)});
+	});
 }
 
 void runGC() {
@@ -39,6 +89,8 @@ void runGC() {
 	time(&x);
 	if (x > gcrun) {
 		fncache.clear();
+		//preloaded modules not requested within a minute are probably not needed anymore
+		if (hotset) hotset->releaseUnused(60);
 	}
 	gcrun = x+5;
 }
@@ -46,41 +98,42 @@ void runGC() {
 
 
  var doResetCommand(ModuleCompiler &comp, const var &cmd) {
+ 	//modules of the current views survive the GC, the same add_fun usually follows
+ 	std::set<const Module *> current;
+ 	for (const PModule &m: views) current.insert(m);
+ 	if (fusedViews != nullptr) current.insert(fusedViews);
+ 	std::vector<std::pair<Hash, PModule> > keep;
+ 	for (auto &&x: fncache) {
+ 		if (current.count(x.second)) keep.push_back(x);
+ 	}
  	views.clear();
+ 	viewSources.clear();
+ 	fusedViews = nullptr;
+ 	fusedTried = false;
  	runGC();
- 	comp.dropEnv();
+ 	fncache.insert(keep.begin(), keep.end());
+ 	//the environment is kept, until the shared code changes (see prepareEnv)
+ 	comp.setSharedCode(Value());
+ 	if (hotset) hotset->save(false);
+ 	if (reduceCache) {
+ 		Value stats = reduceCache->getStats();
+ 		if (stats != reduceCacheStats) {
+ 			logOut(String({"reduce cache: ", stats.toString()}));
+ 			reduceCacheStats = stats;
+ 		}
+ 	}
+ 	if (showCache) {
+ 		Value stats = showCache->getStats();
+ 		if (stats != showCacheStats) {
+ 			logOut(String({"show cache: ", stats.toString()}));
+ 			showCacheStats = stats;
+ 		}
+ 		showCacheFields.clear();
+ 	}
  	return true;
  }
 
 
-class JSONStream {
-public:
-	JSONStream(std::istream &input, std::ostream &output):in(input),out(output) {}
-
-	json::Value read() {
-		return json::Value::fromStream(in);
-	}
-
-	void write(json::Value v) {
-		v.toStream(out);
-		out << std::endl;
-	}
-
-	bool isEof() {
-		int c = in.peek();
-		while (c != EOF && isspace(c)) {
-			in.get();
-			c = in.peek();
-		}
-		return c == EOF;
-	}
-
-protected:
-	std::istream &in;
-	std::ostream &out;
-};
-
-
 
 
 PModule compileFunction(ModuleCompiler& compiler, const StrViewA& cmd) {
@@ -88,29 +141,130 @@ PModule compileFunction(ModuleCompiler& compiler, const StrViewA& cmd) {
 	std::size_t hash = compiler.calcHash(code);
 	PModule &a = fncache[hash];
 	if (a == nullptr) {
-		a = compiler.compile(code);
-		IProc* proc = a->getProc();
-		proc->initLog(&logOut);
+		if (hotset) {
+			String name = ModuleCompiler::getModuleName(hash);
+			hotset->use(name);
+			a = hotset->take(name);
+		}
+		if (a == nullptr) a = compiler.compile(code);
+		initUserLog(*a, hash);
 	}
 	return a;
 }
 
 
+///Replaces modules built in the background and the fused views and starts optimization of profiled modules
+void maintainModules(ModuleCompiler &compiler) {
+	compiler.takeFinished([&](std::size_t hash, const String &path) {
+		PModule n;
+		try {
+			n = new Module(path, hash);
+		} catch (std::exception &e) {
+			logOut(e.what());
+			return;
+		}
+		if (n->getFusedMap()) {
+			initFused(*n, hash);
+			if (fusedTried && hash == fusedHash) {
+				fncache[hash] = n;
+				fusedViews = n;
+			}
+			return;
+		}
+		initUserLog(*n, hash);
+		auto iter = fncache.find(hash);
+		if (iter != fncache.end()) iter->second = n;
+		for (PModule &v: views) {
+			if (v->getHash() == hash) v = n;
+		}
+	});
+	compiler.takeFailed([&](std::size_t hash) {
+		fusedFailed.insert(hash);
+	});
+
+	if (pgoCollect) {
+		time_t now;
+		time(&now);
+		if (now < maintenanceRun) return;
+		maintenanceRun = now+1;
+		for (auto &&x: fncache) {
+			const PModule &m = x.second;
+			if (m == nullptr) continue;
+			if (m->isProfiling() && now - m->getLoadTime() >= pgoCollect) {
+				m->dumpProfile();
+				compiler.rebuildWithProfile(x.first);
+			}
+		}
+	}
+}
+
 var doAddFun(ModuleCompiler &compiler, const StrViewA &cmd) {
 	views.push_back(compileFunction(compiler,cmd));
+	viewSources.push_back(cmd);
+	fusedViews = nullptr;
+	fusedTried = false;
 	return true;
 }
 
-var doMapDoc(const var &cmd) {
+///Returns module with all views fused, or nullptr, if it is not available
+/**
+ * The fused module is built in the background, the views are used separately until
+ * maintainModules() receives the finished module
+ */
+static PModule getFusedViews(ModuleCompiler &compiler) {
+	if (!fuseViews || fusedTried || views.size() < 2) return fusedViews;
+	fusedTried = true;
+	std::vector<StrViewA> codes(viewSources.begin(), viewSources.end());
+	fusedHash = compiler.calcFusedHash(codes);
+	if (fusedFailed.count(fusedHash)) return nullptr;
+	auto iter = fncache.find(fusedHash);
+	if (iter != fncache.end()) {
+		fusedViews = iter->second;
+		return fusedViews;
+	}
+	try {
+		String path = compiler.buildFused(codes);
+		if (!path.empty()) {
+			PModule a = new Module(path, fusedHash);
+			initFused(*a, fusedHash);
+			fncache[fusedHash] = a;
+			fusedViews = a;
+		}
+	} catch (const CompileError &e) {
+		//views may conflict in a single translation unit, use them separately
+		logOut(logWarning, String({"Unable to fuse views, using separate modules: ", e.what()}));
+		fusedFailed.insert(fusedHash);
+	} catch (std::exception &e) {
+		logOut(logWarning, String({"Unable to fuse views: ", e.what()}));
+	}
+	return fusedViews;
+}
+
+var doMapDoc(ModuleCompiler &compiler, const var &cmd) {
 
 
 	Array r;
+	PModule fused = getFusedViews(compiler);
+	if (fused != nullptr) {
+		//emit is bound to fusedOuts by initFused()
+		IFusedMap *m = fused->getFusedMap();
+		unsigned int count = m->getViewCount();
+		for (unsigned int i = 0; i < count; i++) fusedOuts[i].clear();
+		{
+			TraceSpan _("user", fused->getHash());
+			m->mapdoc(cmd[1]);
+		}
+		for (unsigned int i = 0; i < count; i++) r.add(fusedOuts[i]);
+		return r;
+	}
+
 	Array o;
 	IProc::EmitFn emitFn = [&](const Value &key, const Value &value) {
 		o.add({key.defined()?key:Value(nullptr), value.defined()?value:Value(nullptr)});
 	};
 
 	for (PModule x : views) {
+		TraceSpan _("user", x->getHash());
 		o.clear();
 		IProc *p = x->getProc();
 		p->initEmit(emitFn);
@@ -128,9 +282,20 @@ var doReduce(ModuleCompiler &compiler, const Value &cmd) {
 	for (Value f : fns) {
 
 		PModule a = compileFunction(compiler, f.getString());
+		TraceSpan _("user", a->getHash());
 		IProc *proc = a->getProc();
 		Value orgvalues = cmd[2];
-		result.push_back(proc->reduce(RowSet(orgvalues)));
+		if (reduceCache && (a->getFlags() & flagMemoize)) {
+			std::size_t key = ReduceCache::makeKey(compiler.calcHash(f.getString()), false, orgvalues);
+			Value r;
+			if (!reduceCache->find(key, orgvalues, r)) {
+				r = proc->reduce(RowSet(orgvalues));
+				reduceCache->store(key, orgvalues, r);
+			}
+			result.push_back(r);
+		} else {
+			result.push_back(proc->reduce(RowSet(orgvalues)));
+		}
 	}
 	return Value({true,result});
 }
@@ -141,8 +306,19 @@ var doReReduce(ModuleCompiler &compiler, const Value &cmd) {
 	Value fns = cmd[1];
 	for (Value f : fns) {
 		PModule a = compileFunction(compiler,f.getString());
+		TraceSpan _("user", a->getHash());
 		IProc *proc = a->getProc();
-		result.push_back(proc->rereduce(cmd[2]));
+		if (reduceCache && (a->getFlags() & flagMemoize)) {
+			std::size_t key = ReduceCache::makeKey(compiler.calcHash(f.getString()), true, cmd[2]);
+			Value r;
+			if (!reduceCache->find(key, cmd[2], r)) {
+				r = proc->rereduce(cmd[2]);
+				reduceCache->store(key, cmd[2], r);
+			}
+			result.push_back(r);
+		} else {
+			result.push_back(proc->rereduce(cmd[2]));
+		}
 	}
 	return Value({true,result});
 }
@@ -161,57 +337,122 @@ var doAddLib(ModuleCompiler &compiler,  Value lib) {
 	return true;
 }
 
-class TextBuffer {
-public:
-	void clear() {
-		outbuffer.clear();
-	}
-	String str() const {
-		return StrViewA(outbuffer.data(), outbuffer.size());
-	}
-	void push_back(char c) {
-		outbuffer.push_back(c);
-	}
-	void push_back(StrViewA txt) {
-		outbuffer.reserve(outbuffer.size()+txt.length);
-		for (auto c: txt) outbuffer.push_back(c);
-	}
-	Value getChunks() const {
-		if (outbuffer.empty()) return Value(json::array);
-		else return Value(json::array,{str()});
-	}
-
-protected:
-	std::vector<char> outbuffer;
-};
-
 
 static TextBuffer buff;
 
-var doCommandDDocShow(IProc &proc, Value args) {
+///Writes response of show() or update()
+/**
+ * The body is written from the buffer directly to the stream. The value set by setJSONBody()
+ * is passed as the field "json"
+ */
+static void writeShowResponse(JSONStream &stream, const Value &prefix, const Value &respObj, const Value &jsonBody) {
+	if (jsonBody.defined()) {
+		Object resp(respObj);
+		resp.unset("body");
+		resp.unset("base64");
+		resp.set("json", jsonBody);
+		Array res(prefix);
+		res.push_back(resp);
+		stream.write(res);
+	} else {
+		stream.writeResponse(prefix, respObj, buff.view(), buff.isBinary());
+	}
+}
+
+///Runs show(), the body is collected in the buffer
+static void runShow(IProc &proc, Value args, Value &respObj, Value &jsonBody) {
 	buff.clear();
-	Value respObj(json::object);
 	Value doc = args[0];
 	Value request = args[1];
 	proc.initShowListFns([&]() -> ListRow { return Value(nullptr);},
 			[](const StrViewA &v) {buff.push_back(v);},
 	         [&](const Value &resp) {respObj = resp;});
+	proc.initBodyFns([](const BinaryView &v) {buff.push_back(v);},
+			[&](const Value &body) {jsonBody = body;});
 	proc.show(doc,request);
-	return {"resp",respObj.replace(Path::root/"body",buff.str())};
 }
 
-var doCommandDDocUpdates(IProc &proc, Value args) {
+var doCommandDDocShow(IProc &proc, Value args, JSONStream &stream) {
+	Value respObj(json::object);
+	Value jsonBody;
+	runShow(proc, args, respObj, jsonBody);
+	writeShowResponse(stream, {"resp"}, respObj, jsonBody);
+	return Value();
+}
+
+///Retrieves value of the field, nested fields are separated by dots
+static Value getField(Value v, StrViewA path) {
+	std::size_t pos = 0;
+	while (v.type() == json::object) {
+		std::size_t sep = path.indexOf(".", pos);
+		if (sep == path.npos) return v[path.substr(pos)];
+		v = v[path.substr(pos, sep - pos)];
+		pos = sep + 1;
+	}
+	return Value();
+}
+
+///Creates key of the cached response from the document revision and the declared fields of the request
+static Value showCacheKey(const Value &fields, const Value &doc, const Value &request) {
+	Array key;
+	key.reserve(fields.size() + 2);
+	key.push_back(doc["_id"].defined()?doc["_id"]:Value(nullptr));
+	key.push_back(doc["_rev"].defined()?doc["_rev"]:Value(nullptr));
+	//missing document is sent as null, the response can depend on the requested id
+	if (doc.type() != json::object) key.push_back(request["id"].defined()?request["id"]:Value(nullptr));
+	for (Value f: fields) {
+		Value v = getField(request, f.getString());
+		key.push_back(v.defined()?v:Value(nullptr));
+	}
+	return key;
+}
+
+///Show function with cached responses (//!cache)
+/**
+ * @param proc function
+ * @param args arguments (document, request)
+ * @param hash hash of the module
+ * @param fields request fields, which affect the response
+ * @return response
+ */
+var doCommandDDocCachedShow(IProc &proc, Value args, Hash hash, const Value &fields) {
+	Value input = showCacheKey(fields, args[0], args[1]);
+	std::size_t key = ReduceCache::makeKey(hash, false, input);
+	Value resp;
+	if (!showCache->find(key, input, resp)) {
+		Value respObj(json::object);
+		Value jsonBody;
+		runShow(proc, args, respObj, jsonBody);
+		Object r(respObj);
+		r.unset("body");
+		r.unset("base64");
+		if (jsonBody.defined()) r.set("json", jsonBody);
+		else if (buff.isBinary()) r.set("base64", base64Encode(BinaryView(buff.view())));
+		else r.set("body", buff.str());
+		resp = r;
+		std::size_t bodySize = jsonBody.defined()?jsonBody.stringify().length():buff.view().length;
+		if (bodySize <= showCacheMaxBody) showCache->store(key, input, resp);
+	}
+	return {"resp", resp};
+}
+
+var doCommandDDocUpdates(IProc &proc, Value args, JSONStream &stream) {
 	buff.clear();
 	Value respObj(json::object);
+	Value jsonBody;
 	Document doc = args[0];
 	Document newdoc = doc;
 	Value request = args[1];
 	proc.initShowListFns([&] () -> ListRow { return Value(nullptr);},
 			[](const StrViewA &v) {buff.push_back(v);},
 			[&](const Value &resp) {respObj = resp;});
+	proc.initBodyFns([](const BinaryView &v) {buff.push_back(v);},
+			[&](const Value &body) {jsonBody = body;});
 	proc.update(newdoc,request);
+	//compares handles only. DocumentEdit::commit() keeps the handle, if nothing changed
 	if (newdoc.isCopyOf(doc)) newdoc = Value( nullptr);
-	return {"up",newdoc,respObj.replace(Path::root/"body",buff.str())};
+	writeShowResponse(stream, {"up",newdoc}, respObj, jsonBody);
+	return Value();
 }
 
 var doCommandDDocList(IProc &proc, Value args, JSONStream &stream) {
@@ -244,6 +485,8 @@ var doCommandDDocList(IProc &proc, Value args, JSONStream &stream) {
 			},
 			[](const StrViewA &v) {buff.push_back(v);},
 			[&](const Value &resp) {respObj = resp;});
+	proc.initBodyFns([](const BinaryView &) {throw std::runtime_error("sendBinary() is not available in list()");},
+			[](const Value &) {throw std::runtime_error("setJSONBody() is not available in list()");});
 
 	proc.list(head,request);
 	if (needstart) {
@@ -288,7 +531,13 @@ var doCommandDDocValidate(IProc &proc, Value args) {
 	Value userContext = args[2];
 	Value security = args[3];
 
-	ValidationResult res = proc.validate(doc,ContextData(prevDoc, userContext, security));
+	//indexes are reused while the user and the security object are the same
+	static RefCntPtr<const UserIndex> userIndex;
+	static RefCntPtr<const SecurityIndex> securityIndex;
+	if (userIndex == nullptr || userIndex->user != userContext) userIndex = new UserIndex(userContext);
+	if (securityIndex == nullptr || securityIndex->security != security) securityIndex = new SecurityIndex(security);
+
+	ValidationResult res = proc.validate(doc,ContextData(prevDoc, userIndex, securityIndex));
 	switch (res.decree) {
 	case accepted: return 1;
 	case rejected: return {"error","validation_rejected",res.description};
@@ -298,27 +547,129 @@ var doCommandDDocValidate(IProc &proc, Value args) {
 	return 1;
 }
 
+struct DDocFunction {
+	///path of the function in the design document (for example "views/foo/map")
+	String name;
+	///source code
+	StrViewA code;
+};
+
+///Collects all functions of the design document which need to be compiled
+/**
+ * @param doc design document
+ * @return list of functions. Built-in reduce functions and the shared code are skipped
+ */
+std::vector<DDocFunction> collectFunctions(Value doc) {
+	std::vector<DDocFunction> out;
+	auto add = [&](const String &name, Value code) {
+		StrViewA c = code.getString();
+		if (!c.empty() && c[0] != '_') out.push_back(DDocFunction{name,c});
+	};
+	for (StrViewA section: {"shows","lists","updates","filters"}) {
+		for (Value v: doc[section]) add(String({section,"/",v.getKey()}), v);
+	}
+	add("validate_doc_update", doc["validate_doc_update"]);
+	for (Value v: doc["views"]) {
+		StrViewA name = v.getKey();
+		if (name == "lib") continue;
+		add(String({"views/",name,"/map"}), v["map"]);
+		add(String({"views/",name,"/reduce"}), v["reduce"]);
+	}
+	return out;
+}
+
 void precompile(ModuleCompiler &compiler, Value doc) {
 
-	Value views = doc["views"];
-	Value shows = doc["shows"];
-	Value lists = doc["lists"];
-	Value updates = doc["updates"];
-	Value filters = doc["filters"];
-	Value validate = doc["validate_doc_update"];
-	Value lib = views["lib"];
-	compiler.setSharedCode(lib);
+	compiler.setSharedCode(doc["views"]["lib"]);
+	for (auto &&f: collectFunctions(doc)) compileFunction(compiler, f.code);
+}
+
+///Compiles all functions of the design documents into the cache
+/**
+ * @param compiler compiler
+ * @param files list of files, each file contains one design document
+ * @param jobs count of parallel compilations
+ * @return zero when all functions has been compiled, otherwise 1
+ *
+ * Manifest of produced modules is printed to the standard output
+ */
+int buildBundle(ModuleCompiler &compiler, const std::vector<String> &files, unsigned int jobs) {
+
+	Object manifest;
+	int res = 0;
+	for (const String &file: files) {
+		std::ifstream input(file.c_str(), std::ios::in);
+		if (!input) {
+			std::cerr << "Failed to open:" << file << std::endl;
+			res = 1;
+			continue;
+		}
+		Value doc = Value::fromStream(input);
+		String id = doc["_id"].defined()?String(doc["_id"]):file;
+
+		compiler.setSharedCode(doc["views"]["lib"]);
+		compiler.prepareEnv();
+
+		std::vector<DDocFunction> fns = collectFunctions(doc);
+		//functions with the same code are built only once, parallel builds of the same
+		//module would write the same files
+		std::vector<Hash> hashes(fns.size());
+		std::vector<std::size_t> unique;
+		std::vector<std::size_t> slot(fns.size());
+		std::map<Hash, std::size_t> slotByHash;
+		for (std::size_t i = 0; i < fns.size(); i++) {
+			hashes[i] = compiler.calcHash(fns[i].code);
+			auto ins = slotByHash.insert(std::make_pair(hashes[i], unique.size()));
+			if (ins.second) unique.push_back(i);
+			slot[i] = ins.first->second;
+		}
+		std::vector<String> modules(unique.size());
+		std::vector<String> errors(unique.size());
+		std::atomic<std::size_t> next(0);
+
+		auto worker = [&] {
+			std::size_t i;
+			while ((i = next++) < unique.size()) {
+				try {
+					modules[i] = compiler.build(fns[unique[i]].code);
+				} catch (std::exception &e) {
+					errors[i] = e.what();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < jobs && i < unique.size(); i++) threads.push_back(std::thread(worker));
+		worker();
+		for (auto &&t: threads) t.join();
+
+		//the module must be loadable, otherwise it is not published
+		for (std::size_t i = 0; i < unique.size(); i++) {
+			if (!errors[i].empty()) continue;
+			try {
+				Module testOpen(modules[i], hashes[unique[i]]);
+			} catch (std::exception &e) {
+				unlink(modules[i].c_str());
+				errors[i] = String({"Failed to load module: ", e.what()});
+			}
+		}
 
-	compileFunction(compiler, validate.getString());
-	for (auto v: lists) compileFunction(compiler, v.getString());
-	for (auto v: shows) compileFunction(compiler, v.getString());
-	for (auto v: updates) compileFunction(compiler, v.getString());
-	for (auto v: filters) compileFunction(compiler, v.getString());
-	for (auto v: views){
-		compileFunction(compiler, v["map"].getString());
-		Value r = v["reduce"];
-		if (r.getString().empty()) compileFunction(compiler, r.getString());
+		Object ddocManifest;
+		for (std::size_t i = 0; i < fns.size(); i++) {
+			const String &err = errors[slot[i]];
+			if (!err.empty()) {
+				std::cerr << file << ": " << fns[i].name << ": " << err << std::endl;
+				res = 1;
+			} else {
+				ddocManifest(fns[i].name, ModuleCompiler::getModuleName(hashes[i]));
+			}
+		}
+		manifest(id, ddocManifest);
 	}
+	compiler.dropEnv();
+	Value(manifest).toStream(std::cout);
+	std::endl(std::cout);
+	return res;
 }
 
 
@@ -349,11 +700,22 @@ var doCommandDDoc(ModuleCompiler &compiler, const var &cmd, JSONStream &stream)
 
 		StrViewA callType = cmd[2][0].getString();
 		PModule a = compileFunction(compiler,fn.getString());
+		TraceSpan _("user", a->getHash());
 		IProc *proc = a->getProc();
 
-		if (callType == "shows") return doCommandDDocShow(*proc, cmd[3]);
+		if (callType == "shows") {
+			if (showCache) {
+				auto f = showCacheFields.find(a->getHash());
+				if (f == showCacheFields.end()) {
+					f = showCacheFields.insert(std::make_pair(a->getHash(),
+							ModuleCompiler::getCacheFields(fn.getString()))).first;
+				}
+				if (f->second.defined()) return doCommandDDocCachedShow(*proc, cmd[3], a->getHash(), f->second);
+			}
+			return doCommandDDocShow(*proc, cmd[3], stream);
+		}
 		else if (callType == "lists") return doCommandDDocList(*proc, cmd[3], stream);
-		else if (callType == "updates") return doCommandDDocUpdates(*proc, cmd[3]);
+		else if (callType == "updates") return doCommandDDocUpdates(*proc, cmd[3], stream);
 		else if (callType == "filters") return doCommandDDocFilters(*proc, cmd[3]);
 		else if (callType == "views") return doCommandDDocViews(*proc, cmd[3]);
 		else if (callType == "validate_doc_update") return doCommandDDocValidate(*proc, cmd[3]);
@@ -365,6 +727,64 @@ var doCommandDDoc(ModuleCompiler &compiler, const var &cmd, JSONStream &stream)
 
 
 
+///Runs the query server
+/**
+ * @param compiler compiler
+ * @param stream protocol stream
+ * @param hotsetPath path to the manifest of recently used modules
+ * @param hotsetSize count of modules in the manifest (0 - disabled)
+ */
+void serve(ModuleCompiler &compiler, JSONStream &stream, const String &hotsetPath, std::size_t hotsetSize) {
+	std::unique_ptr<HotSet> hotsetInst;
+	if (hotsetSize) {
+		hotsetInst.reset(new HotSet(hotsetPath, hotsetSize));
+		hotset = hotsetInst.get();
+		hotset->preload(compiler);
+	}
+
+	try {
+	while (!stream.isEof()) {
+
+
+		var v = stream.read();
+// 		    logOut(v.toString());
+		var res;
+		try {
+			maintainModules(compiler);
+
+			String cmd ( v[0]);
+			Tracer::setCommand(cmd);
+			TraceSpan _("command");
+			if (cmd == "reset") res = doResetCommand(compiler,v);
+			else if (cmd == "add_lib") res=doAddLib(compiler,v[1]);
+			else if (cmd == "add_fun") res=doAddFun(compiler,v[1].getString());
+			else if (cmd == "reduce") res=doReduce(compiler,v);
+			else if (cmd == "rereduce") res=doReReduce(compiler,v);
+			else if (cmd == "map_doc") res = doMapDoc(compiler, v);
+			else if (cmd == "ddoc") res = doCommandDDoc(compiler,v,stream);
+			else res = {"error","unsupported","Operation is not supported by this query server"};
+
+		} catch (const CompileError &e) {
+			res = {"error","compile_error",e.what()};
+		} catch (const Error &e) {
+			res = {"error", e.type,e.desc };
+		} catch (std::exception &e) {
+			res = {"error", "general_error",e.what() };
+		}
+		//commands, which write the response themselves, return undefined
+		if (res.defined()) stream.write(res);
+
+	}
+
+	} catch (std::exception &e) {
+		stream.write({"error","general_error", e.what() });
+	}
+	if (hotset) hotset->save(true);
+	hotset = nullptr;
+}
+
+
+
 static String getcwd() {
 	char *p = get_current_dir_name();
 	String ret(p);
@@ -382,6 +802,8 @@ static Value loadConfig(const String &path) {
 
 int main(int argc, char **argv) {
 
+	//let std::cin buffer the input, so the reader can take all available data at once
+	std::ios::sync_with_stdio(false);
 	JSONStream stream(std::cin, std::cout);
 
 	try {
@@ -390,8 +812,11 @@ int main(int argc, char **argv) {
 		String tryCompile;
 		String cacheOverride;
 		std::vector<String> populate;
+		std::vector<String> bundle;
+		unsigned int jobs = std::thread::hardware_concurrency();
 		bool clearcache = false;
 		bool needPopulate = false;
+		bool needBundle = false;
 
 
 
@@ -414,7 +839,7 @@ int main(int argc, char **argv) {
 				}
 			}
 			else if (a == "-h") {
-				std::cerr << argv[0] << " -f <config> [ -c <file> [ -l <dir>] ] [ -p <files...>][-c][-o <dir>]" << std::endl;
+				std::cerr << argv[0] << " -f <config> [ -c <file> [ -l <dir>] ] [ -p <files...>][ -b <files...> [-j <n>]][-c][-o <dir>]" << std::endl;
 				std::cerr << std::endl;
 				std::cerr << "-f\tSpecifies path to configuration file (mandatory)" << std::endl;
 				std::cerr << std::endl;
@@ -423,6 +848,9 @@ int main(int argc, char **argv) {
 						  << "\ta report is send to standard error (and return value indicates error)" << std::endl;
 				std::cerr << "-l\tSpecify path to lib directory" << std::endl ;
 				std::cerr << "-p\tPopuplate the cache by compiling specified files" << std::endl ;
+				std::cerr << "-b\tPopuplate the cache by compiling all functions of design documents" << std::endl
+						  << "\tstored in specified files (JSON). Manifest of modules is printed to the standard output" << std::endl;
+				std::cerr << "-j\tCount of parallel compilations for the option -b (default: count of CPUs)" << std::endl;
 				std::cerr << "-r\tClear cache"<< std::endl << std::endl;
 				std::cerr << "-o\tPut results to the specified directory (overrides configuration file)"<< std::endl << std::endl;
 
@@ -435,6 +863,16 @@ int main(int argc, char **argv) {
 				}
 				needPopulate = true;
 			}
+			else if (a == "-b") {
+				while (argp < argc && argv[argp][0] != '-') {
+					bundle.push_back(relpath(cwd,argv[argp++]));
+				}
+				needBundle = true;
+			}
+			else if (a == "-j") {
+				if (argp >= argc) throw std::runtime_error("Missing argument after -j");
+				jobs = (unsigned int)strtoul(argv[argp++],0,10);
+			}
 			else if (a == "-r") {
 				clearcache = true;
 			}
@@ -450,7 +888,14 @@ int main(int argc, char **argv) {
 		cwd = cfgpath.substr(0, cfgpath.lastIndexOf("/"));
 
 
-		Value x = cfg["cache"];
+		Value logCfg = cfg["log"];
+		Value x = logCfg["level"];
+		if (x.defined()) logger.setLevel(Logger::parseLevel(x.getString()));
+		x = logCfg["user"];
+		if (x.defined()) logger.setUserLevel(Logger::parseLevel(x.getString()));
+		logger.setRateLimit(logCfg["rateLimit"].getUInt());
+
+		x = cfg["cache"];
 		if (!x.defined()) throw std::runtime_error("Missing 'cache' in config");
 		String strcache = relpath(cwd,String(x));
 		x = cfg["compiler"]["program"];
@@ -463,10 +908,16 @@ int main(int argc, char **argv) {
 		String strlibs(x);
 
 		bool keepSources = cfg["keepSource"].getBool();
+		std::size_t hotsetSize = cfg["hotset"].getUInt();
+		std::size_t reduceCacheSize = cfg["reduceCache"].getUInt();
+		std::size_t showCacheSize = cfg["showCache"].getUInt();
+		if (cfg["showCacheMaxBody"].defined()) showCacheMaxBody = cfg["showCacheMaxBody"].getUInt();
+		fuseViews = cfg["fuseViews"].getBool();
 		if (!cacheOverride.empty()) strcache = cacheOverride;
 
 
 		ModuleCompiler compiler(strcache, strcompiler, strparams, strlibs, keepSources);
+		compiler.setTimeout(cfg["compiler"]["timeout"].getUInt());
 
 		if (clearcache) {
 			compiler.clearCache();
@@ -482,40 +933,75 @@ int main(int argc, char **argv) {
 			}
 			return 0;
 		}
+		if (needBundle) {
+			if (bundle.empty()) {
+				std::cerr << "Nothing to build" << std::endl;
+				return 1;
+			}
+			logger.setStream(&std::cerr);
+			return buildBundle(compiler, bundle, jobs?jobs:1);
+		}
 
-		try {
-		while (!stream.isEof()) {
+		x = cfg["compiler"]["quick"];
+		if (x.defined()) compiler.setQuick(String(x));
+
+		Value pgo = cfg["compiler"]["pgo"];
+		if (pgo.defined()) {
+			x = pgo["generate"];
+			String pgoGenerate = x.defined()?String(x):String("-fprofile-generate -fprofile-update=atomic");
+			x = pgo["use"];
+			String pgoUse = x.defined()?String(x):String("-fprofile-use -fprofile-correction");
+			x = pgo["collect"];
+			pgoCollect = x.defined()?x.getUInt():300;
+			compiler.setPGO(pgoGenerate, pgoUse);
+		}
 
+		//outlives the compiler, whose background thread can still record spans
+		static std::unique_ptr<Tracer> tracerInst;
+		Value traceCfg = cfg["trace"];
+		if (traceCfg.defined()) {
+			x = traceCfg["maxSize"];
+			tracerInst.reset(new Tracer(strcache, x.defined()?x.getUInt():64*1024*1024));
+			tracer = tracerInst.get();
+		}
 
-			var v = stream.read();
-// 		    logOut(v.toString());
-			var res;
-			try {
+		std::unique_ptr<ReduceCache> reduceCacheInst;
+		if (reduceCacheSize) {
+			reduceCacheInst.reset(new ReduceCache(reduceCacheSize));
+			reduceCache = reduceCacheInst.get();
+		}
+		std::unique_ptr<ReduceCache> showCacheInst;
+		if (showCacheSize) {
+			showCacheInst.reset(new ReduceCache(showCacheSize));
+			showCache = showCacheInst.get();
+		}
 
-				String cmd ( v[0]);
-				if (cmd == "reset") res = doResetCommand(compiler,v);
-				else if (cmd == "add_lib") res=doAddLib(compiler,v[1]);
-				else if (cmd == "add_fun") res=doAddFun(compiler,v[1].getString());
-				else if (cmd == "reduce") res=doReduce(compiler,v);
-				else if (cmd == "rereduce") res=doReReduce(compiler,v);
-				else if (cmd == "map_doc") res = doMapDoc(v);
-				else if (cmd == "ddoc") res = doCommandDDoc(compiler,v,stream);
-				else res = {"error","unsupported","Operation is not supported by this query server"};
-
-			} catch (const CompileError &e) {
-				res = {"error","compile_error",e.what()};
-			} catch (const Error &e) {
-				res = {"error", e.type,e.desc };
+		String hotsetPath({strcache,"/hotset.json"});
+		//log lines are sent along with the responses
+		logger.setBatch(true);
+		unsigned int workers = cfg["workers"].getUInt();
+		if (workers) {
+			WorkerPool pool(workers, cfg["workerTimeout"].getUInt(),
+				[&](std::istream &in, std::ostream &out) {
+					logger.setStream(&out);
+					JSONStream wstream(in, out);
+					serve(compiler, wstream, hotsetPath, hotsetSize);
+					compiler.dropEnv();
+				},
+				[&](const Value &v) {stream.write(v);},
+				[&] {return stream.read();});
+			try {
+				while (!stream.isEof()) {
+					var v = stream.read();
+					stream.write(pool.process(v));
+				}
 			} catch (std::exception &e) {
-				res = {"error", "general_error",e.what() };
+				stream.write({"error","general_error", e.what() });
 			}
-			stream.write(res);
-
-		}
-
-		} catch (std::exception &e) {
-			stream.write({"error","general_error", e.what() });
+		} else {
+			serve(compiler, stream, hotsetPath, hotsetSize);
 		}
+		logger.setBatch(false);
 
 	} catch (std::exception &e) {
 		std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,145 @@
+/*
+ * hotset.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <vector>
+#include "hotset.h"
+
+HotSet::HotSet(String manifestPath, std::size_t maxCount)
+	:manifestPath(manifestPath)
+	,maxCount(maxCount)
+	,stop(false)
+{
+
+}
+
+HotSet::~HotSet() {
+	stop = true;
+	if (thr.joinable()) thr.join();
+}
+
+void HotSet::use(const String &moduleName) {
+	std::size_t &c = used[moduleName];
+	if (c != counter) {
+		c = ++counter;
+		dirty = true;
+	}
+}
+
+///Reads the manifest, returns undefined value, if it doesn't exist or it is corrupted
+static Value readManifest(const String &manifestPath) {
+	std::ifstream in(manifestPath.c_str(), std::ios::in);
+	if (!in) return Value();
+	try {
+		return Value::fromStream(in);
+	} catch (std::exception &e) {
+		logOut(logWarning, String({"Ignoring corrupted manifest: ", manifestPath, " - ", e.what()}));
+		return Value();
+	}
+}
+
+void HotSet::save(bool force) {
+	if (!dirty) return;
+	time_t now;
+	time(&now);
+	if (!force && now < nextSave) return;
+	nextSave = now + 10;
+
+	//other processes share the manifest, it is merged under the lock
+	String lockPath({manifestPath,".lock"});
+	int fd = open(lockPath.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0666);
+	if (fd < 0) {
+		logOut(logWarning, String({"Unable to lock the manifest: ", lockPath}));
+		return;
+	}
+	int r;
+	while ((r = flock(fd, LOCK_EX)) < 0 && errno == EINTR) {}
+
+	std::vector<std::pair<std::size_t, String> > order;
+	order.reserve(used.size());
+	for (auto &&x: used) order.push_back(std::make_pair(x.second, x.first));
+	std::sort(order.begin(), order.end(), [](const std::pair<std::size_t, String> &a, const std::pair<std::size_t, String> &b) {
+		return a.first > b.first;
+	});
+
+	//modules used since the last save go first, then the manifest, then the rest of the modules used by this process
+	Array manifest;
+	std::set<String> present;
+	auto add = [&](const String &name) {
+		if (manifest.size() < maxCount && present.insert(name).second) manifest.push_back(name);
+	};
+	for (auto &&x: order) if (x.first > savedCounter) add(x.second);
+	for (Value v: readManifest(manifestPath)) add(String(v));
+	for (auto &&x: order) if (x.first <= savedCounter) add(x.second);
+
+	if (order.size() > maxCount) {
+		for (std::size_t i = maxCount; i < order.size(); i++) used.erase(order[i].second);
+	}
+
+	String tmpPath({manifestPath,".",Value(getpid()).toString()});
+	{
+		std::ofstream out(tmpPath.c_str(), std::ios::out|std::ios::trunc);
+		if (!out) {
+			logOut(logWarning, String({"Unable to write the manifest: ", tmpPath}));
+			close(fd);
+			return;
+		}
+		Value(manifest).toStream(out);
+	}
+	rename(tmpPath.c_str(), manifestPath.c_str());
+	close(fd);
+	savedCounter = counter;
+	dirty = false;
+}
+
+void HotSet::preload(const ModuleCompiler &compiler) {
+	Value manifest = readManifest(manifestPath);
+	if (!manifest.defined()) return;
+
+	String cachePath = compiler.getCachePath();
+	thr = std::thread([=] {
+		for (Value v: manifest) {
+			if (stop) break;
+			String name(v);
+			String path({cachePath,"/",name,".so"});
+			if (access(path.c_str(), F_OK) != 0) continue;
+			try {
+				PModule m = new Module(path);
+				std::lock_guard<std::mutex> _(lock);
+				preloaded[name] = m;
+			} catch (std::exception &e) {
+				logOut(logWarning, String({"Preload failed: ", e.what()}));
+			}
+		}
+	});
+}
+
+PModule HotSet::take(const String &moduleName) {
+	std::lock_guard<std::mutex> _(lock);
+	auto iter = preloaded.find(moduleName);
+	if (iter == preloaded.end()) return nullptr;
+	PModule m = iter->second;
+	preloaded.erase(iter);
+	return m;
+}
+
+void HotSet::releaseUnused(unsigned int maxAge) {
+	time_t now;
+	time(&now);
+	std::lock_guard<std::mutex> _(lock);
+	for (auto iter = preloaded.begin(); iter != preloaded.end();) {
+		if (now - iter->second->getLoadTime() >= (time_t)maxAge) iter = preloaded.erase(iter);
+		else ++iter;
+	}
+}
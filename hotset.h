@@ -0,0 +1,71 @@
+/*
+ * hotset.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "module.h"
+
+///Tracks recently used modules and preloads them after the restart
+/**
+ * The manifest of recently used modules is stored in the cache. When the query server
+ * starts, modules listed in the manifest are loaded by a background thread, so first
+ * requests don't need to wait to dlopen() and initialization of the module.
+ */
+class HotSet {
+public:
+
+	///Constructor
+	/**
+	 * @param manifestPath path to the manifest
+	 * @param maxCount maximum count of modules in the manifest
+	 */
+	HotSet(String manifestPath, std::size_t maxCount);
+	~HotSet();
+
+	///Records that module has been used
+	void use(const String &moduleName);
+	///Writes the manifest, if there are changes
+	/**
+	 * The manifest is shared by all processes using the cache. It is merged with the manifest
+	 * on the disk under the lock, modules used since the last save are moved to the front.
+	 *
+	 * @param force set true to write now, otherwise the manifest is written at most once per 10 seconds
+	 */
+	void save(bool force);
+	///Starts the background thread, which loads modules listed in the manifest
+	void preload(const ModuleCompiler &compiler);
+	///Retrieves preloaded module
+	/**
+	 * @param moduleName name of the module
+	 * @return preloaded module, or nullptr, if the module has not been preloaded (yet)
+	 */
+	PModule take(const String &moduleName);
+	///Unloads preloaded modules, which have not been taken
+	/**
+	 * @param maxAge minimal age of the module in seconds
+	 */
+	void releaseUnused(unsigned int maxAge);
+
+protected:
+	String manifestPath;
+	std::size_t maxCount;
+
+	std::map<String, std::size_t> used;
+	std::size_t counter = 0;
+	///value of the counter at the last save
+	std::size_t savedCounter = 0;
+	bool dirty = false;
+	time_t nextSave = 0;
+
+	std::mutex lock;
+	std::map<String, PModule> preloaded;
+	std::thread thr;
+	std::atomic<bool> stop;
+};
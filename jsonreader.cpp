@@ -0,0 +1,70 @@
+/*
+ * jsonreader.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <cstring>
+#include "jsonreader.h"
+
+JSONReader::JSONReader(std::istream &in):in(in) {}
+
+bool JSONReader::fill() {
+	std::streambuf *sb = in.rdbuf();
+	//blocks until some data are available
+	if (sb->in_avail() <= 0 && sb->sgetc() == std::char_traits<char>::eof()) return false;
+	std::streamsize avail = sb->in_avail();
+	if (avail <= 0) avail = 1;
+	if (start > 0 && start * 2 >= buffer.size()) {
+		buffer.erase(buffer.begin(), buffer.begin()+start);
+		start = 0;
+	}
+	std::size_t sz = buffer.size();
+	buffer.resize(sz + avail);
+	std::streamsize n = sb->sgetn(buffer.data()+sz, avail);
+	buffer.resize(sz + n);
+	return n > 0;
+}
+
+bool JSONReader::skipWhitespaces() {
+	for(;;) {
+		while (start < buffer.size() && isspace((unsigned char)buffer[start])) start++;
+		if (start < buffer.size()) return true;
+		buffer.clear();
+		start = 0;
+		if (!fill()) return false;
+	}
+}
+
+bool JSONReader::isEof() {
+	return !skipWhitespaces();
+}
+
+Value JSONReader::read() {
+	return Value::fromString(readMessage());
+}
+
+StrViewA JSONReader::readMessage() {
+	if (!skipWhitespaces()) throw std::runtime_error("Unexpected end of stream");
+	//the message ends by the end of line, the text searched before the last fill() is not searched again
+	std::size_t pos = start;
+	std::size_t end;
+	for(;;) {
+		const void *nl = memchr(buffer.data()+pos, '\n', buffer.size()-pos);
+		if (nl) {
+			end = static_cast<const char *>(nl) - buffer.data();
+			break;
+		}
+		//positions are relative to the buffer, which can be compacted by fill()
+		std::size_t searched = buffer.size() - start;
+		if (!fill()) {
+			end = buffer.size();
+			break;
+		}
+		pos = start + searched;
+	}
+	StrViewA msg(buffer.data()+start, end-start);
+	start = end;
+	return msg;
+}
@@ -0,0 +1,51 @@
+/*
+ * jsonreader.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <iostream>
+#include <vector>
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Reads JSON messages from the stream
+/**
+ * The reader reads all available data to the buffer and splits the messages by the end of
+ * line. Both CouchDB and the workers send one message per line (the strings can't contain
+ * the line break unescaped). The message is parsed from the memory then.
+ */
+class JSONReader {
+public:
+	JSONReader(std::istream &in);
+
+	///Reads next message
+	/**
+	 * @return parsed message
+	 * @exception std::runtime_error unexpected end of stream
+	 */
+	Value read();
+
+	///Reads text of the next message without parsing
+	/**
+	 * Blocks until the whole message is buffered.
+	 *
+	 * @return text of the message. It is valid until the next call
+	 * @exception std::runtime_error unexpected end of stream
+	 */
+	StrViewA readMessage();
+
+	///Returns true, if there are no more messages
+	bool isEof();
+
+protected:
+	std::istream &in;
+	std::vector<char> buffer;
+	std::size_t start = 0;
+
+	bool fill();
+	bool skipWhitespaces();
+};
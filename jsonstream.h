@@ -0,0 +1,89 @@
+/*
+ * jsonstream.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <iostream>
+#include <string>
+#include "api.h"
+#include "jsonreader.h"
+#include "jsonwriter.h"
+#include "logger.h"
+#include "tracer.h"
+
+///Protocol stream - reads commands and writes responses
+class JSONStream {
+public:
+	JSONStream(std::istream &input, std::ostream &output):reader(input),out(output) {}
+
+	json::Value read() {
+		//waiting for the message is not part of the span
+		json::StrViewA msg = reader.readMessage();
+		TraceSpan _("parse");
+		return json::Value::fromString(msg);
+	}
+
+	void write(json::Value v) {
+		TraceSpan _("serialize");
+		wrbuff.clear();
+		logger.takePending(wrbuff);
+		writeJSON(v, wrbuff);
+		wrbuff.push_back('\n');
+		out.write(wrbuff.data(), wrbuff.size());
+		out.flush();
+	}
+
+	///Writes response of show() or update()
+	/**
+	 * The body is written directly from the buffer, without creating a string value
+	 *
+	 * @param prefix items of the response before the response object (for example ["resp"])
+	 * @param resp response object. Its fields "body" and "base64" are replaced by the body
+	 * @param body content of the body
+	 * @param binary true to write the body as "base64", false to write it as "body"
+	 */
+	void writeResponse(const json::Value &prefix, const json::Value &resp, json::StrViewA body, bool binary) {
+		TraceSpan _("serialize");
+		wrbuff.clear();
+		logger.takePending(wrbuff);
+		wrbuff.push_back('[');
+		for (json::Value x: prefix) {
+			writeJSON(x, wrbuff);
+			wrbuff.push_back(',');
+		}
+		wrbuff.push_back('{');
+		for (json::Value x: resp) {
+			json::StrViewA key = x.getKey();
+			if (key == "body" || key == "base64") continue;
+			writeJSONString(key, wrbuff);
+			wrbuff.push_back(':');
+			writeJSON(x, wrbuff);
+			wrbuff.push_back(',');
+		}
+		if (binary) {
+			wrbuff.append("\"base64\":\"");
+			std::size_t pos = wrbuff.size();
+			wrbuff.resize(pos + base64EncodedSize(body.length));
+			base64Encode(json::BinaryView(body), &wrbuff[pos]);
+			wrbuff.push_back('"');
+		} else {
+			wrbuff.append("\"body\":");
+			writeJSONString(body, wrbuff);
+		}
+		wrbuff.append("}]\n");
+		out.write(wrbuff.data(), wrbuff.size());
+		out.flush();
+	}
+
+	bool isEof() {
+		return reader.isEof();
+	}
+
+protected:
+	JSONReader reader;
+	std::ostream &out;
+	std::string wrbuff;
+};
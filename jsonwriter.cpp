@@ -0,0 +1,228 @@
+/*
+ * jsonwriter.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "jsonwriter.h"
+
+using namespace json;
+
+static const char hexChars[] = "0123456789abcdef";
+
+///Returns length of valid UTF-8 sequence at the position, or 0 if the sequence is not valid
+static std::size_t utf8SeqLen(const unsigned char *s, std::size_t remain) {
+	unsigned char c = s[0];
+	std::size_t len;
+	unsigned int cp;
+	if (c >= 0xC2 && c <= 0xDF) {len = 2; cp = c & 0x1F;}
+	else if (c >= 0xE0 && c <= 0xEF) {len = 3; cp = c & 0x0F;}
+	else if (c >= 0xF0 && c <= 0xF4) {len = 4; cp = c & 0x07;}
+	else return 0;
+	if (remain < len) return 0;
+	for (std::size_t i = 1; i < len; i++) {
+		if ((s[i] & 0xC0) != 0x80) return 0;
+		cp = (cp << 6) | (s[i] & 0x3F);
+	}
+	//overlong forms, surrogates and code points above U+10FFFF
+	if (len == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) return 0;
+	if (len == 4 && (cp < 0x10000 || cp > 0x10FFFF)) return 0;
+	return len;
+}
+
+///Escapes single character which needs attention (or whole run of valid UTF-8 sequences)
+/**
+ * @return count of bytes processed
+ */
+static inline std::size_t escapeChar(const unsigned char *s, std::size_t remain, std::string &out) {
+	unsigned char c = *s;
+	if (c >= 0x80) {
+		//whole run of multibyte sequences is copied, so the text in national alphabets doesn't
+		//return to the block loop after every character
+		std::size_t run = 0;
+		while (run < remain && s[run] >= 0x80) {
+			std::size_t len = utf8SeqLen(s+run, remain-run);
+			if (!len) break;
+			run += len;
+		}
+		if (run) {
+			out.append(reinterpret_cast<const char *>(s), run);
+			return run;
+		}
+		out.append("\\ufffd");
+		return 1;
+	}
+	switch (c) {
+	case '"': out.append("\\\""); break;
+	case '\\': out.append("\\\\"); break;
+	case '\b': out.append("\\b"); break;
+	case '\f': out.append("\\f"); break;
+	case '\n': out.append("\\n"); break;
+	case '\r': out.append("\\r"); break;
+	case '\t': out.append("\\t"); break;
+	default:
+		if (c < 0x20) {
+			char buff[6] = {'\\','u','0','0',hexChars[c >> 4],hexChars[c & 0xF]};
+			out.append(buff, 6);
+		} else {
+			out.push_back((char)c);
+		}
+		break;
+	}
+	return 1;
+}
+
+static inline bool needEscape(unsigned char c) {
+	return c < 0x20 || c >= 0x80 || c == '"' || c == '\\';
+}
+
+void escapeStringScalar(StrViewA str, std::string &out) {
+	const unsigned char *s = reinterpret_cast<const unsigned char *>(str.data);
+	std::size_t len = str.length;
+	std::size_t pos = 0;
+	while (pos < len) {
+		std::size_t beg = pos;
+		while (pos < len && !needEscape(s[pos])) pos++;
+		out.append(str.data+beg, pos-beg);
+		if (pos < len) pos += escapeChar(s+pos, len-pos, out);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+void escapeStringSSE2(StrViewA str, std::string &out) {
+	const unsigned char *s = reinterpret_cast<const unsigned char *>(str.data);
+	std::size_t len = str.length;
+	std::size_t pos = 0;
+	//signed comparison: bytes >= 0x80 are negative, so they are caught with the control characters
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	while (pos + 16 <= len) {
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s+pos));
+		__m128i m = _mm_or_si128(_mm_cmplt_epi8(b, space),
+				_mm_or_si128(_mm_cmpeq_epi8(b, quote), _mm_cmpeq_epi8(b, bslash)));
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+		if (mask == 0) {
+			out.append(str.data+pos, 16);
+			pos += 16;
+		} else {
+			std::size_t clean = __builtin_ctz(mask);
+			out.append(str.data+pos, clean);
+			pos += clean;
+			pos += escapeChar(s+pos, len-pos, out);
+		}
+	}
+	escapeStringScalar(StrViewA(str.data+pos, len-pos), out);
+}
+
+__attribute__((target("avx2")))
+void escapeStringAVX2(StrViewA str, std::string &out) {
+	const unsigned char *s = reinterpret_cast<const unsigned char *>(str.data);
+	std::size_t len = str.length;
+	std::size_t pos = 0;
+	const __m256i space = _mm256_set1_epi8(0x20);
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i bslash = _mm256_set1_epi8('\\');
+	while (pos + 32 <= len) {
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s+pos));
+		__m256i m = _mm256_or_si256(_mm256_cmpgt_epi8(space, b),
+				_mm256_or_si256(_mm256_cmpeq_epi8(b, quote), _mm256_cmpeq_epi8(b, bslash)));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+		if (mask == 0) {
+			out.append(str.data+pos, 32);
+			pos += 32;
+		} else {
+			std::size_t clean = __builtin_ctz(mask);
+			out.append(str.data+pos, clean);
+			pos += clean;
+			pos += escapeChar(s+pos, len-pos, out);
+		}
+	}
+	escapeStringSSE2(StrViewA(str.data+pos, len-pos), out);
+}
+
+EscapeFn selectEscape() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return &escapeStringAVX2;
+	return &escapeStringSSE2;
+}
+
+#else
+
+EscapeFn selectEscape() {
+	return &escapeStringScalar;
+}
+
+#endif
+
+static const EscapeFn escapeString = selectEscape();
+
+void writeJSON(const Value &v, std::string &out) {
+	switch (v.type()) {
+	case json::undefined:
+	case json::null:
+		out.append("null");
+		break;
+	case json::boolean:
+		out.append(v.getBool()?"true":"false");
+		break;
+	case json::string:
+		if (v.flags() & json::binaryString) {
+			//binary strings are encoded by imtjson
+			String s = v.stringify();
+			out.append(s.c_str(), s.length());
+		} else {
+			out.push_back('"');
+			escapeString(v.getString(), out);
+			out.push_back('"');
+		}
+		break;
+	case json::number:
+		if ((v.flags() & (json::numberInteger|json::numberUnsignedInteger)) == json::numberInteger) {
+			char buff[32];
+			int n = snprintf(buff, sizeof(buff), "%lld", static_cast<long long>(v.getIntLong()));
+			out.append(buff, n);
+		} else {
+			String s = v.stringify();
+			out.append(s.c_str(), s.length());
+		}
+		break;
+	case json::array: {
+		out.push_back('[');
+		bool comma = false;
+		for (Value x: v) {
+			if (comma) out.push_back(',');
+			comma = true;
+			writeJSON(x, out);
+		}
+		out.push_back(']');
+		break;
+	}
+	case json::object: {
+		out.push_back('{');
+		bool comma = false;
+		for (Value x: v) {
+			if (comma) out.push_back(',');
+			comma = true;
+			out.push_back('"');
+			escapeString(x.getKey(), out);
+			out.append("\":");
+			writeJSON(x, out);
+		}
+		out.push_back('}');
+		break;
+	}
+	}
+}
+
+void writeJSONString(StrViewA str, std::string &out) {
+	out.push_back('"');
+	escapeString(str, out);
+	out.push_back('"');
+}
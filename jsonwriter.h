@@ -0,0 +1,47 @@
+/*
+ * jsonwriter.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <string>
+#include <imtjson/json.h>
+
+#define COUCHCPP_WRITER_API __attribute__ ((visibility ("default")))
+
+///Appends escaped content of the JSON string (without quotes)
+/**
+ * @param str string to escape. Invalid UTF-8 sequences are replaced by U+FFFD
+ * @param out output buffer
+ */
+typedef void (*EscapeFn)(json::StrViewA str, std::string &out);
+
+///Scalar escaping (processes character by character)
+COUCHCPP_WRITER_API void escapeStringScalar(json::StrViewA str, std::string &out);
+#if defined(__x86_64__) || defined(__i386__)
+///SSE2 escaping (checks 16 bytes at once)
+COUCHCPP_WRITER_API void escapeStringSSE2(json::StrViewA str, std::string &out);
+///AVX2 escaping (checks 32 bytes at once), requires CPU with AVX2
+COUCHCPP_WRITER_API void escapeStringAVX2(json::StrViewA str, std::string &out);
+#endif
+///Selects the fastest escaping supported by the CPU
+COUCHCPP_WRITER_API EscapeFn selectEscape();
+
+///Serializes the value to the buffer
+/**
+ * Produces JSON equivalent to Value::stringify(), but the strings are escaped by blocks
+ * and the result is appended to the reusable buffer
+ *
+ * @param v value to serialize
+ * @param out output buffer. The result is appended
+ */
+COUCHCPP_WRITER_API void writeJSON(const json::Value &v, std::string &out);
+
+///Serializes the text as JSON string (including quotes)
+/**
+ * @param str text to serialize. Invalid UTF-8 sequences are replaced by U+FFFD
+ * @param out output buffer. The result is appended
+ */
+COUCHCPP_WRITER_API void writeJSONString(json::StrViewA str, std::string &out);
@@ -0,0 +1,136 @@
+/*
+ * launcher.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <system_error>
+#include "launcher.h"
+
+extern char **environ;
+
+Command::Command(String program) {
+	args.push_back(program);
+}
+
+Command &Command::arg(const String &a) {
+	args.push_back(a);
+	return *this;
+}
+
+Command &Command::opts(StrViewA opts) {
+	std::string cur;
+	bool inArg = false;
+	char quote = 0;
+	for (char c: opts) {
+		if (quote) {
+			if (c == quote) quote = 0;
+			else cur.push_back(c);
+		} else if (c == '"' || c == '\'') {
+			quote = c;
+			inArg = true;
+		} else if (isspace(c)) {
+			if (inArg) {
+				args.push_back(cur);
+				cur.clear();
+				inArg = false;
+			}
+		} else {
+			cur.push_back(c);
+			inArg = true;
+		}
+	}
+	if (inArg) args.push_back(cur);
+	return *this;
+}
+
+String Command::toString() const {
+	std::string out;
+	for (auto &&a: args) {
+		if (!out.empty()) out.push_back(' ');
+		out.append(a.c_str(), a.length());
+	}
+	return out;
+}
+
+int Command::run(std::string &output, unsigned int timeout) const {
+
+	std::vector<char *> argv;
+	argv.reserve(args.size()+1);
+	for (auto &&a: args) argv.push_back(const_cast<char *>(a.c_str()));
+	argv.push_back(nullptr);
+
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC))
+		throw std::system_error(errno, std::generic_category(), "pipe");
+
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&fa, fds[1], 1);
+	posix_spawn_file_actions_adddup2(&fa, fds[1], 2);
+
+	//the program runs in its own process group, so the timeout can kill all its children
+	//(cc1plus, as, ld), not only the driver
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	pid_t pid;
+	int r = posix_spawn(&pid, argv[0], &fa, &attr, argv.data(), environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&fa);
+	close(fds[1]);
+	if (r) {
+		close(fds[0]);
+		throw std::system_error(r, std::generic_category(), String({"Failed to start: ", args[0]}).c_str());
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+	bool expired = false;
+	char buff[4096];
+	for(;;) {
+		int wait = -1;
+		if (timeout) {
+			auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			if (remain.count() <= 0) {
+				expired = true;
+				break;
+			}
+			wait = (int)remain.count();
+		}
+		pollfd pfd;
+		pfd.fd = fds[0];
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int p = poll(&pfd, 1, wait);
+		if (p < 0 && errno != EINTR) break;
+		if (p <= 0) continue;
+		ssize_t n = read(fds[0], buff, sizeof(buff));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		output.append(buff, n);
+	}
+	close(fds[0]);
+
+	if (expired) kill(-pid, SIGKILL);
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+
+	if (expired) {
+		output.append("Timeout expired, the program has been terminated\n");
+		return -1;
+	}
+	if (WIFSIGNALED(status)) return 128+WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
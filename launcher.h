@@ -0,0 +1,56 @@
+/*
+ * launcher.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Command line of an external program (the compiler)
+/**
+ * The program is started directly through posix_spawn() without the shell and without
+ * the fork() of the whole process. Arguments are passed as vector, so no shell expansion
+ * is performed.
+ *
+ * The object can be used from multiple threads, each thread can run its own command
+ */
+class Command {
+public:
+	///Constructor
+	/**
+	 * @param program full path to the program
+	 */
+	Command(String program);
+
+	///Adds single argument
+	Command &arg(const String &a);
+	///Adds options separated by whitespaces.
+	/**
+	 * Double and single quotes can be used to pass an argument containing whitespaces
+	 */
+	Command &opts(StrViewA opts);
+
+	///Returns command line as text (for the log)
+	String toString() const;
+
+	///Runs the command and waits for exit
+	/**
+	 * @param output standard output and standard error of the program is appended here
+	 * @param timeout timeout in seconds. Zero means no timeout. When timeout expires, the
+	 * program is killed together with its child processes (the program runs in its own process group)
+	 * @return exit code of the program. If the program is terminated by a signal, the
+	 * function returns 128+signal. Function returns -1 when timeout expires
+	 *
+	 * @exception std::system_error failed to start the program
+	 */
+	int run(std::string &output, unsigned int timeout) const;
+
+protected:
+	std::vector<String> args;
+};
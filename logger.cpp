@@ -0,0 +1,138 @@
+/*
+ * logger.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include "logger.h"
+#include "jsonwriter.h"
+#include "module.h"
+
+///Maximum size of pending lines, further messages are dropped
+static const std::size_t maxPending = 4*1024*1024;
+
+Logger logger;
+
+void logOut(const StrViewA & msg) {
+	logger.write(logInfo, msg);
+}
+
+void logOut(LogLevel level, const StrViewA & msg) {
+	logger.write(level, msg);
+}
+
+Logger::Logger()
+	:stream(&std::cout)
+	,level(logInfo)
+	,userLevel(logDebug)
+	,rateLimit(0)
+	,batch(false)
+	,dropped(0) {}
+
+void Logger::setStream(std::ostream *stream) {
+	std::lock_guard<std::mutex> _(lock);
+	this->stream = stream;
+	pending.clear();
+	rates.clear();
+	dropped = 0;
+}
+
+void Logger::setLevel(LogLevel level) {
+	std::lock_guard<std::mutex> _(lock);
+	this->level = level;
+}
+
+void Logger::setUserLevel(LogLevel level) {
+	std::lock_guard<std::mutex> _(lock);
+	this->userLevel = level;
+}
+
+void Logger::setRateLimit(unsigned int perSecond) {
+	std::lock_guard<std::mutex> _(lock);
+	rateLimit = perSecond;
+}
+
+void Logger::setBatch(bool batch) {
+	std::lock_guard<std::mutex> _(lock);
+	this->batch = batch;
+	if (!batch) writePending();
+}
+
+void Logger::write(LogLevel level, const StrViewA &msg) {
+	std::lock_guard<std::mutex> _(lock);
+	if (level < this->level) return;
+	append(level, StrViewA(), msg);
+	if (!batch) writePending();
+}
+
+void Logger::writeUser(std::size_t fnHash, LogLevel level, const StrViewA &msg) {
+	std::lock_guard<std::mutex> _(lock);
+	if (level < userLevel) return;
+	if (rateLimit) {
+		RateState &st = rates[fnHash];
+		time_t now = time(nullptr);
+		if (st.second != now) {
+			st.second = now;
+			st.count = 0;
+		}
+		if (st.count >= rateLimit) {
+			st.suppressed++;
+			return;
+		}
+		st.count++;
+	}
+	append(level, StrViewA(), msg);
+	if (!batch) writePending();
+}
+
+void Logger::takePending(std::string &buffer) {
+	std::lock_guard<std::mutex> _(lock);
+	appendSummaries();
+	buffer.append(pending);
+	pending.clear();
+}
+
+void Logger::append(LogLevel level, const StrViewA &prefix, const StrViewA &msg, bool force) {
+	if (pending.size() >= maxPending && !force) {
+		dropped++;
+		return;
+	}
+	static const StrViewA levelNames[] = {"debug: ", "", "warning: ", "error: "};
+	static const EscapeFn escape = selectEscape();
+	pending.append("[\"log\",\"(couchcpp) ");
+	escapeStringScalar(levelNames[level], pending);
+	escapeStringScalar(prefix, pending);
+	escape(msg, pending);
+	pending.append("\"]\n");
+}
+
+void Logger::appendSummaries() {
+	for (auto &&r: rates) {
+		if (r.second.suppressed) {
+			String name({"Log of the function ", ModuleCompiler::getModuleName(r.first), ": "});
+			append(logWarning, name, String({Value(r.second.suppressed).toString()," messages suppressed"}), true);
+			r.second.suppressed = 0;
+		}
+	}
+	if (dropped) {
+		append(logWarning, StrViewA(), String({Value(dropped).toString()," log messages dropped"}), true);
+		dropped = 0;
+	}
+}
+
+void Logger::writePending() {
+	appendSummaries();
+	if (pending.empty()) return;
+	stream->write(pending.data(), pending.size());
+	stream->flush();
+	pending.clear();
+}
+
+LogLevel Logger::parseLevel(const StrViewA &name) {
+	if (name == "debug") return logDebug;
+	if (name == "info") return logInfo;
+	if (name == "warning") return logWarning;
+	if (name == "error") return logError;
+	throw std::runtime_error(String({"Unknown log level: ", name}).c_str());
+}
@@ -0,0 +1,84 @@
+/*
+ * logger.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "parts/common.h"
+
+///Collects messages for the couchdb's log
+/**
+ * In the batch mode, the lines are kept in the memory and they are sent along with
+ * the next response (see takePending()), so logging doesn't need to write to the
+ * stream inside of the user code. Messages of the user functions are limited per function
+ * and second, suppressed messages are reported as a summary. Without the batch mode, the
+ * lines are written to the stream immediately.
+ *
+ * The object is MT safe
+ */
+class Logger {
+public:
+	Logger();
+
+	///Sets the stream. Pending lines and counters are discarded
+	void setStream(std::ostream *stream);
+	///Sets minimal level of messages of the query server
+	void setLevel(LogLevel level);
+	///Sets minimal level of messages of the user functions
+	void setUserLevel(LogLevel level);
+	///Sets maximum count of messages per second of a single user function (0 - unlimited)
+	void setRateLimit(unsigned int perSecond);
+	///Enables or disables the batch mode. Pending lines are written when the batch mode is disabled
+	void setBatch(bool batch);
+
+	///Writes message of the query server
+	void write(LogLevel level, const StrViewA &msg);
+	///Writes message of the user function
+	/**
+	 * @param fnHash hash of the function (identifies the function for rate limit)
+	 * @param level level of the message
+	 * @param msg message
+	 */
+	void writeUser(std::size_t fnHash, LogLevel level, const StrViewA &msg);
+
+	///Moves pending lines to the buffer
+	/**
+	 * Appends also summaries of suppressed messages
+	 *
+	 * @param buffer buffer where the lines are appended. Each line is terminated by a new line
+	 */
+	void takePending(std::string &buffer);
+
+	///Parses name of the level ("debug", "info", "warning", "error")
+	static LogLevel parseLevel(const StrViewA &name);
+
+protected:
+	struct RateState {
+		time_t second = 0;
+		unsigned int count = 0;
+		unsigned int suppressed = 0;
+	};
+
+	std::mutex lock;
+	std::ostream *stream;
+	LogLevel level, userLevel;
+	unsigned int rateLimit;
+	bool batch;
+	std::string pending;
+	std::size_t dropped;
+	std::unordered_map<std::size_t, RateState> rates;
+
+	void append(LogLevel level, const StrViewA &prefix, const StrViewA &msg, bool force = false);
+	void appendSummaries();
+	void writePending();
+};
+
+///Messages of the query server and the user code
+extern Logger logger;
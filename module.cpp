@@ -5,8 +5,15 @@
  *      Author: ondra
  */
 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "module.h"
+#include "launcher.h"
+#include "schema.h"
+#include "selector.h"
+#include "tracer.h"
 #include <dlfcn.h>
 #include <imtjson/fnv.h>
 #include <cstring>
@@ -14,26 +21,42 @@
 #include <ftw.h>
 #include <signal.h>
 
-Module::Module(String path):path(path) {
+Module::Module(String path, std::size_t hash):path(path),hash(hash) {
 
+	TraceSpan _("dlopen", hash);
 	libHandle = dlopen(path.c_str(),RTLD_NOW);
 	if (libHandle == nullptr)
 		throw std::runtime_error(String({"Cannot open module: ", path, " - ", strerror(errno)}).c_str());
 
 	EntryPoint e = (EntryPoint)dlsym(libHandle, "initProc");
-	if (e == nullptr) {
+	FusedEntryPoint fe = (FusedEntryPoint)dlsym(libHandle, "initFusedMap");
+	if (e == nullptr && fe == nullptr) {
 		dlclose(libHandle);
 		throw std::runtime_error(String({"Module is corrupted: ", path, " - ", strerror(errno)}).c_str());
 	}
 
-	proc = e();
-	logOut(String({"load: ", path}));
+	proc = e?e():nullptr;
+	fused = fe?fe():nullptr;
+	time(&loadTime);
+	GetProfileDump p = (GetProfileDump)dlsym(libHandle, "getProfileDump");
+	profileDump = p?p():nullptr;
+	GetModuleFlags f = (GetModuleFlags)dlsym(libHandle, "getModuleFlags");
+	flags = f?f():0;
+	logOut(logDebug, String({"load: ", path}));
+}
+
+void Module::dumpProfile() {
+	if (profileDump) {
+		profileDump();
+		profileDump = nullptr;
+	}
 }
 
 Module::~Module() {
-	proc->onClose();
+	if (proc) proc->onClose();
+	if (fused) fused->onClose();
 	dlclose(libHandle);
-	logOut(String({"unload: ", path}));
+	logOut(logDebug, String({"unload: ", path}));
 }
 
 ModuleCompiler::ModuleCompiler(String cachePath, String gccPath, String gccOpts, String gccLibs, bool keepSource)
@@ -57,8 +80,36 @@ String hashToModuleName(std::size_t sz) {
 	return String({"mod_",StrViewA(buff, c- buff)});
 }
 
+String ModuleCompiler::getModuleName(std::size_t hash) {
+	return hashToModuleName(hash);
+}
+
 PModule ModuleCompiler::compile(StrViewA code) const {
+	PModule a = new Module(build(code), calcHash(code));
+	return a;
+}
+
+///Runs the compiler, throws CompileError with the output of the compiler when it fails
+/// (std::runtime_error when the timeout expires)
+static void runCompiler(const Command &cmd, unsigned int timeout) {
+
+	logOut(logDebug, String({"compile: ", cmd.toString()}));
+	TraceSpan _("g++");
+
+	std::string output;
+	int res = cmd.run(output, timeout);
+	//timeout is not reported as CompileError, the same code can succeed later
+	if (res < 0) {
+		throw std::runtime_error(output);
+	}
+	if (res != 0) {
+		throw CompileError(output);
+	}
+}
+
+String ModuleCompiler::build(StrViewA code) const {
 	std::size_t hash = calcHash(code);
+	TraceSpan _("compile", hash);
 	String strhash = hashToModuleName(hash);
 
 
@@ -81,39 +132,380 @@ PModule ModuleCompiler::compile(StrViewA code) const {
 			t.write(src.sourceCode.c_str(), src.sourceCode.length());
 		}
 
+		if (src.pgo && !pgoGenerate.empty()) {
+			String instPath;
+			try {
+				instPath = buildInstrumented(hash, envSrcPath, src.libraries);
+			} catch (...) {
+				if (keepSource) rename(envSrcPath.c_str(), srcPath.c_str());
+				throw;
+			}
+			if (keepSource) rename(envSrcPath.c_str(), srcPath.c_str());
+			return instPath;
+		}
 
-		String cmdLine({
-			gccPath, " ",
-			gccOpts, " ",
-			" -o ", envModulePath,
-			" ", envSrcPath,
-			" ",src.libraries,
-			" ",gccLibs,
-			" 2>&1"});
-
-		logOut(String({"compile: ", cmdLine}));
-
+		if (!quickOpts.empty()) {
+			String quickPath = buildQuick(hash, envSrcPath, src.libraries);
+			if (keepSource) rename(envSrcPath.c_str(), srcPath.c_str());
+			return quickPath;
+		}
 
-		FILE *f = popen(cmdLine.c_str(), "r");
-		if (f == NULL) {
-			if (!keepSource) unlink(srcPath.c_str());
-			throw std::runtime_error(String({"Failed to invoke compiler: ",cmdLine}).c_str());
+		try {
+			runCompiler(sourceCommand()
+					.arg("-o").arg(envModulePath)
+					.arg(envSrcPath)
+					.opts(src.libraries)
+					.opts(gccLibs), timeout);
+		} catch (...) {
+			if (keepSource) rename(envSrcPath.c_str(), srcPath.c_str());
+			throw;
 		}
-		std::ostringstream buffer;
-		char buff[128];
-		while (fgets(buff,128,f) != NULL) buffer << buff;
-		int res = pclose(f);
 		if (keepSource) {
 			rename(envSrcPath.c_str(), srcPath.c_str());
 		}
-		if (res != 0) {
-			throw CompileError(buffer.str());
-		}
 		rename(envModulePath.c_str(), modulePath.c_str());
 	}
 
-	PModule a = new Module(modulePath);
-	return a;
+	return modulePath;
+}
+
+std::size_t ModuleCompiler::calcFusedHash(const std::vector<StrViewA> &codes) const {
+	std::string joined("//!fused\n");
+	for (StrViewA c: codes) {
+		joined.append(c.data, c.length);
+		joined.push_back('\0');
+	}
+	return calcHash(joined);
+}
+
+String ModuleCompiler::buildFused(const std::vector<StrViewA> &codes) const {
+	std::size_t hash = calcFusedHash(codes);
+	String strhash = hashToModuleName(hash);
+	String modulePath ({cachePath,"/",strhash,".so"});
+	if (access(modulePath.c_str(), F_OK) == 0) return modulePath;
+
+	{
+		std::lock_guard<std::mutex> _(bgLock);
+		if (!bgPending.insert(hash).second) return String();
+	}
+
+	String pidStr = Value(getpid()).toString();
+	String srcPath ({cachePath,"/",strhash,".cpp"});
+	String iiPath ({cachePath,"/",strhash,".",pidStr,".ii"});
+	String tmpPath ({cachePath,"/",strhash,".",pidStr,".so"});
+	SourceInfo src;
+
+	try {
+		src = createFusedSource(codes);
+		String envPath = prepareEnv();
+		String envSrcPath ({envPath,"/", strhash,".cpp"});
+		{
+			std::ofstream t(envSrcPath.c_str(),std::ios::out);
+			if (!t) {
+				throw std::runtime_error(String({"Failed to create file: ",srcPath}).c_str());
+			}
+			t.write(src.sourceCode.c_str(), src.sourceCode.length());
+		}
+		//the source is preprocessed, because the environment can be dropped before the background build starts
+		try {
+			runCompiler(sourceCommand().arg("-E").arg("-o").arg(iiPath).arg(envSrcPath), timeout);
+		} catch (...) {
+			if (keepSource) rename(envSrcPath.c_str(), srcPath.c_str());
+			else unlink(envSrcPath.c_str());
+			throw;
+		}
+		if (keepSource) rename(envSrcPath.c_str(), srcPath.c_str());
+		else unlink(envSrcPath.c_str());
+	} catch (...) {
+		unlink(iiPath.c_str());
+		std::lock_guard<std::mutex> _(bgLock);
+		bgPending.erase(hash);
+		throw;
+	}
+
+	Command cmd = Command(gccPath).opts(gccOpts).arg("-o").arg(tmpPath).arg(iiPath)
+			.opts(src.libraries).opts(gccLibs);
+	unsigned int timeout = this->timeout;
+
+	runInBackground([=] {
+		try {
+			runCompiler(cmd, timeout);
+			rename(tmpPath.c_str(), modulePath.c_str());
+			std::lock_guard<std::mutex> _(bgLock);
+			bgFinished.push_back(std::make_pair(hash, modulePath));
+		} catch (const CompileError &e) {
+			logOut(logWarning, String({"Unable to fuse views: ", e.what()}));
+			std::lock_guard<std::mutex> _(bgLock);
+			bgFailed.push_back(hash);
+		} catch (std::exception &e) {
+			//timeout or a system error, the fused module can be tried again later
+			logOut(logWarning, String({"Fused build failed: ", modulePath, " - ", e.what()}));
+		}
+		unlink(tmpPath.c_str());
+		unlink(iiPath.c_str());
+		std::lock_guard<std::mutex> _(bgLock);
+		bgPending.erase(hash);
+	});
+	return String();
+}
+
+void ModuleCompiler::setTimeout(unsigned int timeout) {
+	this->timeout = timeout;
+}
+
+void ModuleCompiler::setQuick(String quickOpts) {
+	this->quickOpts = quickOpts;
+}
+
+String ModuleCompiler::buildQuick(std::size_t hash, const String &envSrcPath, const String &libraries) const {
+	String strhash = hashToModuleName(hash);
+	String quickPath ({cachePath,"/",strhash,".quick.so"});
+	String modulePath ({cachePath,"/",strhash,".so"});
+
+	{
+		std::lock_guard<std::mutex> _(bgLock);
+		if (!bgPending.insert(hash).second) return quickPath;
+	}
+
+	String pidStr = Value(getpid()).toString();
+	String iiPath ({cachePath,"/",strhash,".",pidStr,".ii"});
+	String tmpPath ({cachePath,"/",strhash,".",pidStr,".so"});
+
+	try {
+		//the source is preprocessed, because the environment can be dropped before the background build starts
+		runCompiler(sourceCommand().arg("-E").arg("-o").arg(iiPath).arg(envSrcPath), timeout);
+		if (access(quickPath.c_str(), F_OK) != 0) {
+			runCompiler(Command(gccPath).opts(quickOpts).arg("-o").arg(tmpPath).arg(iiPath)
+					.opts(libraries).opts(gccLibs), timeout);
+			rename(tmpPath.c_str(), quickPath.c_str());
+		}
+	} catch (...) {
+		unlink(iiPath.c_str());
+		std::lock_guard<std::mutex> _(bgLock);
+		bgPending.erase(hash);
+		throw;
+	}
+
+	Command cmd = Command(gccPath).opts(gccOpts).arg("-o").arg(tmpPath).arg(iiPath)
+			.opts(libraries).opts(gccLibs);
+	unsigned int timeout = this->timeout;
+
+	runInBackground([=] {
+		try {
+			runCompiler(cmd, timeout);
+			rename(tmpPath.c_str(), modulePath.c_str());
+			unlink(quickPath.c_str());
+			std::lock_guard<std::mutex> _(bgLock);
+			bgFinished.push_back(std::make_pair(hash, modulePath));
+		} catch (std::exception &e) {
+			logOut(logWarning, String({"Optimization failed: ", modulePath, " - ", e.what()}));
+		}
+		unlink(iiPath.c_str());
+		std::lock_guard<std::mutex> _(bgLock);
+		bgPending.erase(hash);
+	});
+	return quickPath;
+}
+
+void ModuleCompiler::setPGO(String generateOpts, String useOpts) {
+	pgoGenerate = generateOpts;
+	pgoUse = useOpts;
+}
+
+///Locks the directory of the profile guided optimization of the module
+/**
+ * Only the process, which holds the lock, builds the instrumented module or optimizes it
+ *
+ * @param pgoDir directory
+ * @param wait wait for the lock
+ * @return descriptor of the lock (close it to unlock), -1 if the directory is locked by
+ * an other process
+ */
+static int lockPGODir(const String &pgoDir, bool wait) {
+	String lockPath ({pgoDir,"/.lock"});
+	int fd = open(lockPath.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0666);
+	if (fd < 0) throw std::runtime_error(String({"Failed to create file: ",lockPath}).c_str());
+	int r;
+	while ((r = flock(fd, wait?LOCK_EX:LOCK_EX|LOCK_NB)) < 0 && errno == EINTR) {}
+	if (r < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+///Copies the profile to a private file
+/**
+ * The file is locked by fcntl() as libgcov does, so the copy doesn't contain a half-written dump
+ * of an other process
+ *
+ * @retval true copied
+ * @retval false profile is not available
+ */
+static bool copyProfile(const String &from, const String &to) {
+	int in = open(from.c_str(), O_RDONLY|O_CLOEXEC);
+	if (in < 0) return false;
+	struct flock fl;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_RDLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(in, F_SETLKW, &fl) < 0 && errno == EINTR) {}
+	std::ofstream out(to.c_str(), std::ios::out|std::ios::trunc|std::ios::binary);
+	char buff[4096];
+	ssize_t n;
+	while ((n = read(in, buff, sizeof(buff))) > 0) out.write(buff, n);
+	close(in);
+	return !!out;
+}
+
+String ModuleCompiler::buildInstrumented(std::size_t hash, const String &envSrcPath, const String &libraries) const {
+	String strhash = hashToModuleName(hash);
+	String pgoDir ({cachePath,"/",strhash,".pgo"});
+	String instPath ({pgoDir,"/inst.so"});
+	String profilePath ({pgoDir,"/module.gcda"});
+
+	{
+		std::lock_guard<std::mutex> _(bgLock);
+		pgoLibs[hash] = libraries;
+	}
+
+	if (access(instPath.c_str(), F_OK) == 0) {
+		//profile from the previous run is available, optimize now
+		if (access(profilePath.c_str(), F_OK) == 0) rebuildWithProfile(hash);
+		return instPath;
+	}
+
+	mkdir(pgoDir.c_str(),0777);
+	int lock = lockPGODir(pgoDir, true);
+	try {
+		//an other process could build it while we were waiting
+		if (access(instPath.c_str(), F_OK) != 0) {
+			String pid = Value(getpid()).toString();
+			String iiTmp ({pgoDir,"/src.",pid,".ii"});
+			String instTmp ({pgoDir,"/inst.",pid,".so"});
+			//the name of the object defines the name of the profile (module.gcda), so it
+			//is the same for all processes. It is written only under the lock
+			String objPath ({pgoDir,"/module.o"});
+
+			//the source is preprocessed, so both builds use the same code regardless on shared code
+			runCompiler(sourceCommand().arg("-D__COUCHCPP_PROFILE").arg("-E")
+					.arg("-o").arg(iiTmp).arg(envSrcPath), timeout);
+			rename(iiTmp.c_str(), String({pgoDir,"/src.ii"}).c_str());
+			runCompiler(Command(gccPath).opts(gccOpts).opts(pgoGenerate).arg("-c")
+					.arg("-o").arg(objPath).arg(String({pgoDir,"/src.ii"})), timeout);
+			runCompiler(Command(gccPath).opts(gccOpts).opts(pgoGenerate)
+					.arg("-o").arg(instTmp).arg(objPath).opts(libraries).opts(gccLibs), timeout);
+			unlink(objPath.c_str());
+			rename(instTmp.c_str(), instPath.c_str());
+		}
+	} catch (...) {
+		close(lock);
+		throw;
+	}
+	close(lock);
+	return instPath;
+}
+
+void ModuleCompiler::rebuildWithProfile(std::size_t hash) const {
+	String strhash = hashToModuleName(hash);
+	String pgoDir ({cachePath,"/",strhash,".pgo"});
+	String modulePath ({cachePath,"/",strhash,".so"});
+
+	//only one process optimizes the module. The others try again later
+	int lock = lockPGODir(pgoDir, false);
+	if (lock < 0) return;
+
+	String libraries;
+	{
+		std::lock_guard<std::mutex> _(bgLock);
+		auto iter = pgoLibs.find(hash);
+		if (iter == pgoLibs.end()) {
+			close(lock);
+			return;
+		}
+		libraries = iter->second;
+		pgoLibs.erase(iter);
+	}
+
+	String pid = Value(getpid()).toString();
+	String iiPath ({pgoDir,"/src.ii"});
+	String profilePath ({pgoDir,"/module.gcda"});
+	//the profile is searched by the name of the object
+	String objPath ({pgoDir,"/opt.",pid,".o"});
+	String objProfilePath ({pgoDir,"/opt.",pid,".gcda"});
+	String optPath ({pgoDir,"/opt.",pid,".so"});
+	Command compileCmd = Command(gccPath).opts(gccOpts).opts(pgoUse).arg("-c")
+			.arg("-o").arg(objPath).arg(iiPath);
+	Command linkCmd = Command(gccPath).opts(gccOpts)
+			.arg("-o").arg(optPath).arg(objPath).opts(libraries).opts(gccLibs);
+	unsigned int timeout = this->timeout;
+
+	runInBackground([=] {
+		try {
+			//an other process could optimize the module already
+			if (access(modulePath.c_str(), F_OK) != 0) {
+				copyProfile(profilePath, objProfilePath);
+				runCompiler(compileCmd, timeout);
+				runCompiler(linkCmd, timeout);
+				rename(optPath.c_str(), modulePath.c_str());
+				unlink(String({pgoDir,"/inst.so"}).c_str());
+			}
+			unlink(objPath.c_str());
+			unlink(objProfilePath.c_str());
+			close(lock);
+			std::lock_guard<std::mutex> _(bgLock);
+			bgFinished.push_back(std::make_pair(hash, modulePath));
+		} catch (std::exception &e) {
+			unlink(objPath.c_str());
+			unlink(objProfilePath.c_str());
+			unlink(optPath.c_str());
+			close(lock);
+			logOut(logWarning, String({"Optimization failed: ", modulePath, " - ", e.what()}));
+		}
+	});
+}
+
+void ModuleCompiler::runInBackground(std::function<void()> job) const {
+	std::lock_guard<std::mutex> _(bgLock);
+	bgQueue.push_back(job);
+	if (!bgThread.joinable()) {
+		bgThread = std::thread([this] {
+			std::unique_lock<std::mutex> lk(bgLock);
+			while (!bgStop) {
+				if (bgQueue.empty()) {
+					bgCond.wait(lk);
+				} else {
+					std::function<void()> job = bgQueue.front();
+					bgQueue.pop_front();
+					lk.unlock();
+					job();
+					lk.lock();
+				}
+			}
+		});
+	} else {
+		bgCond.notify_one();
+	}
+}
+
+void ModuleCompiler::takeFinished(std::function<void(std::size_t, const String &)> fn) const {
+	std::vector<std::pair<std::size_t, String> > finished;
+	{
+		std::lock_guard<std::mutex> _(bgLock);
+		if (bgFinished.empty()) return;
+		std::swap(finished, bgFinished);
+	}
+	for (auto &&x: finished) fn(x.first, x.second);
+}
+
+void ModuleCompiler::takeFailed(std::function<void(std::size_t)> fn) const {
+	std::vector<std::size_t> failed;
+	{
+		std::lock_guard<std::mutex> _(bgLock);
+		if (bgFailed.empty()) return;
+		std::swap(failed, bgFailed);
+	}
+	for (std::size_t x: failed) fn(x);
 }
 
 struct SeparatedSrc {
@@ -121,6 +513,10 @@ struct SeparatedSrc {
 	String libs;
 	String source;
 	String namespaces;
+	bool pgo = false;
+	bool memoize = false;
+	///Request fields declared by //!cache, undefined if missing
+	Value cacheFields;
 };
 
 static StrViewA hashline("#line ");
@@ -147,6 +543,9 @@ SeparatedSrc separateSrc(StrViewA src, StrViewA lineMarkerFile) {
 	std::vector<char> includes;
 	std::vector<char> libs;
 	std::vector<char> namespaces;
+	bool pgo = false;
+	bool memoize = false;
+	Value cacheFields;
 
 
 	includes.reserve(src.length);
@@ -217,6 +616,34 @@ SeparatedSrc separateSrc(StrViewA src, StrViewA lineMarkerFile) {
 				libs.push_back((char)c);
 				c = getNext();
 			}
+		} else if (checkKw(c,"//!pgo",false)) {
+			pgo = true;
+			c = getNext();
+			while (c != '\n' && c != '\r' && c != -1) {
+				c = getNext();
+			}
+		} else if (checkKw(c,"//!memoize",false)) {
+			memoize = true;
+			c = getNext();
+			while (c != '\n' && c != '\r' && c != -1) {
+				c = getNext();
+			}
+		} else if (checkKw(c,"//!cache",false)) {
+			Array fields;
+			std::string f;
+			c = getNext();
+			while (true) {
+				bool eol = c == '\n' || c == '\r' || c == -1;
+				if (eol || isspace(c)) {
+					if (!f.empty()) fields.push_back(StrViewA(f));
+					f.clear();
+					if (eol) break;
+				} else {
+					f.push_back((char)c);
+				}
+				c = getNext();
+			}
+			cacheFields = fields;
 		} else if (checkKw(c,"//",true)) {
 			includes.push_back((char)c);
 			copyLineEx(libs);
@@ -235,6 +662,9 @@ SeparatedSrc separateSrc(StrViewA src, StrViewA lineMarkerFile) {
 	s.headers = StrViewA(includes.data(), includes.size());
 	s.libs = StrViewA(libs.data(),libs.size());
 	s.namespaces = StrViewA(namespaces.data(),namespaces.size());
+	s.pgo = pgo;
+	s.memoize = memoize;
+	s.cacheFields = cacheFields;
 	includes.clear();
 	appendLineMarker(includes);
 	s.source = {StrViewA(includes.data(),includes.size()),src.substr(pos) };
@@ -243,13 +673,45 @@ SeparatedSrc separateSrc(StrViewA src, StrViewA lineMarkerFile) {
 
 
 
+///Detects the selector filter (//!selector followed by JSON)
+/**
+ * @param code source code
+ * @param selector receives the JSON text of the selector
+ * @retval true code is selector
+ * @retval false code is C++
+ */
+static bool isSelector(StrViewA code, StrViewA &selector) {
+	static const StrViewA directive("//!selector");
+	std::size_t pos = 0;
+	while (pos < code.length && isspace((unsigned char)code[pos])) pos++;
+	if (code.substr(pos, directive.length) != directive) return false;
+	selector = code.substr(pos + directive.length);
+	return true;
+}
+
+Value ModuleCompiler::getCacheFields(StrViewA code) {
+	return separateSrc(code, StrViewA()).cacheFields;
+}
+
 ModuleCompiler::SourceInfo ModuleCompiler::createSource(StrViewA code, String lineMarkerFile){
 
+	StrViewA selector;
+	if (isSelector(code, selector)) {
+		String gen;
+		try {
+			gen = generateSelectorSource(Value::fromString(selector));
+		} catch (std::exception &e) {
+			throw CompileError(e.what());
+		}
+		return createSource(gen, lineMarkerFile);
+	}
+
 	SeparatedSrc src = separateSrc(code, lineMarkerFile);
 
 	SourceInfo srcinfo;
 	srcinfo.sourceCode = String({
 		"#define __COUCHCPP_COMPILER \"" INTERFACE_VERSION "\"\n",
+		src.memoize?"#define __COUCHCPP_FLAGS (flagMemoize)\n":"",
 		"#include <couchcpp/parts/common.h>\n",
 		src.headers,
 		"namespace {\n",
@@ -259,10 +721,67 @@ ModuleCompiler::SourceInfo ModuleCompiler::createSource(StrViewA code, String li
 		"}\n"
 		"#include <couchcpp/parts/entryPoint.h>\n"});
 	srcinfo.libraries = src.libs;
+	srcinfo.pgo = src.pgo;
+	return srcinfo;
+}
+
+ModuleCompiler::SourceInfo ModuleCompiler::createFusedSource(const std::vector<StrViewA> &codes) {
+
+	std::vector<SeparatedSrc> srcs;
+	for (std::size_t i = 0; i < codes.size(); i++) {
+		srcs.push_back(separateSrc(codes[i], String({"view_", Value(i).toString()})));
+	}
+
+	std::ostringstream out;
+	out << "#define __COUCHCPP_COMPILER \"" INTERFACE_VERSION "\"\n"
+			"#include <couchcpp/parts/common.h>\n";
+	for (auto &&s: srcs) out << s.headers << "\n";
+	out << "namespace {\n";
+	for (std::size_t i = 0; i < srcs.size(); i++) {
+		out << "namespace view_" << i << " {\n"
+			<< srcs[i].namespaces
+			<< "class Proc: public AbstractProc {\n"
+			   "public:\n" << srcs[i].source << "\nprivate: //are we still in class?\n};\n"
+			   "}\n";
+	}
+	//members are called directly, so the compiler can inline the map functions
+	out << "class FusedMap: public IFusedMap {\n"
+		   "public:\n"
+		   "\tvirtual void mapdoc(Document doc) override {\n";
+	for (std::size_t i = 0; i < srcs.size(); i++) out << "\t\tv" << i << ".mapdoc(doc);\n";
+	out << "\t}\n"
+		   "\tvirtual unsigned int getViewCount() const override {return " << srcs.size() << ";}\n"
+		   "\tvirtual void onClose() override {delete this;}\n"
+		   "\tvirtual void initEmit(EmitFn fn) override {\n";
+	for (std::size_t i = 0; i < srcs.size(); i++)
+		out << "\t\tv" << i << ".initEmit([fn](const Value &k, const Value &v) {fn(" << i << ",k,v);});\n";
+	out << "\t}\n"
+		   "\tvirtual void initLog(IProc::LogFn fn) override {\n";
+	for (std::size_t i = 0; i < srcs.size(); i++) out << "\t\tv" << i << ".initLog(fn);\n";
+	out << "\t}\n"
+		   "protected:\n";
+	for (std::size_t i = 0; i < srcs.size(); i++) out << "\tview_" << i << "::Proc v" << i << ";\n";
+	out << "};\n"
+		   "}\n"
+		   "extern \"C\" {\n"
+		   "__attribute__ ((visibility (\"default\"))) IFusedMap *initFusedMap() {\n"
+		   "\t\treturn new FusedMap;\n"
+		   "\t}\n"
+		   "}\n";
+
+	SourceInfo srcinfo;
+	srcinfo.sourceCode = String(out.str());
+	std::string libs;
+	for (auto &&s: srcs) {
+		libs.append(s.libs.c_str(), s.libs.length());
+		libs.push_back(' ');
+	}
+	srcinfo.libraries = String(libs);
 	return srcinfo;
 }
 
 std::size_t ModuleCompiler::calcHash(const StrViewA code) const {
+	TraceSpan _("calcHash");
 
 	StrViewA version(INTERFACE_VERSION);
 	std::size_t h;
@@ -274,10 +793,7 @@ std::size_t ModuleCompiler::calcHash(const StrViewA code) const {
 }
 
 void ModuleCompiler::setSharedCode(Value sharedCode) {
-	if (this->sharedCode != sharedCode) {
-		this->sharedCode = sharedCode;
-		dropEnv();
-	}
+	this->sharedCode = sharedCode;
 }
 
 static void doAddLib(String cachePath, Value lib) {
@@ -297,7 +813,17 @@ static void doAddLib(String cachePath, Value lib) {
 					throw std::runtime_error(String({"Unable to write to file:", path}).c_str());
 				}
 				outf.write(content.data, content.length);
-				logOut(String({"Imported: ", path}));
+				logOut(logDebug, String({"Imported: ", path}));
+				if (key.length > 12 && key.substr(key.length-12) == ".schema.json") {
+					String hdrPath = {cachePath,"/", key.substr(0,key.length-5),".h"};
+					String hdr = generateSchemaHeader(Value::fromString(content));
+					std::ofstream hdrf(hdrPath.c_str(), std::ios::out| std::ios::trunc);
+					if (!hdrf) {
+						throw std::runtime_error(String({"Unable to write to file:", hdrPath}).c_str());
+					}
+					hdrf.write(hdr.c_str(), hdr.length());
+					logOut(logDebug, String({"Generated: ", hdrPath}));
+				}
 			} else {
 				logOut(String({"Warning: Can't import :",x.toString()}));
 			}
@@ -308,20 +834,6 @@ static void doAddLib(String cachePath, Value lib) {
 }
 
 
-String ModuleCompiler::prepareEnv() const {
-	if (!envPath.empty()) return envPath;
-	pid_t curPid = getpid();
-	String pidStr = Value(curPid).toString();
-	envPath = String({cachePath,"/",pidStr});
-	mkdir(envPath.c_str(),0777);
-
-	doAddLib(envPath, sharedCode);
-
-	logOut(String({"Environment prepared at: ", envPath}));
-
-	return envPath;
-}
-
 static int walkClear(const char *fname, const struct stat *, int type, struct FTW *) {
 	switch (type) {
 	case FTW_DP: rmdir(fname);break;
@@ -332,16 +844,128 @@ static int walkClear(const char *fname, const struct stat *, int type, struct FT
 	return 0;
 }
 
+///Removes the snapshot, if it is not used by any process
+/**
+ * @param path path to the snapshot
+ */
+static void collectSnapshot(const String &path) {
+	String lockPath ({path,"/.lock"});
+	int fd = open(lockPath.c_str(), O_RDONLY|O_CLOEXEC);
+	if (fd < 0) return;
+	if (flock(fd, LOCK_EX|LOCK_NB) == 0) {
+		//processes waiting for the lock find, that the snapshot has been removed
+		String deadPath ({path,".",Value(getpid()).toString(),".dead"});
+		if (rename(path.c_str(), deadPath.c_str()) == 0) {
+			nftw(deadPath.c_str(),&walkClear,20,FTW_DEPTH|FTW_PHYS|FTW_MOUNT);
+			logOut(logDebug, String({"Removed unused snapshot: ", path}));
+		}
+	}
+	close(fd);
+}
 
-void ModuleCompiler::dropEnv() {
+void ModuleCompiler::acquireSnapshot() const {
+	if (!sharedCode.defined() || sharedCode.empty()) return;
+
+	StrViewA version(INTERFACE_VERSION);
+	std::size_t h;
+	FNV1a<sizeof(std::size_t)> hash(h);
+	for (char c : StrViewA(sharedCode.stringify())) hash(c);
+	for (char c : version) hash(c);
+	String name ({"lib_",StrViewA(hashToModuleName(h)).substr(4)});
+	String path ({cachePath,"/",name});
+	String lockPath ({path,"/.lock"});
+
+	for (int retry = 0; retry < 10; retry++) {
+		if (access(lockPath.c_str(), F_OK) != 0) {
+			//created in the environment of the process and published by rename
+			String tmpPath ({envPath,"/",name});
+			nftw(tmpPath.c_str(),&walkClear,20,FTW_DEPTH|FTW_PHYS|FTW_MOUNT);
+			mkdir(tmpPath.c_str(),0777);
+			doAddLib(tmpPath, sharedCode);
+			std::ofstream(String({tmpPath,"/.lock"}).c_str(), std::ios::out);
+			if (rename(tmpPath.c_str(), path.c_str()) == 0) {
+				logOut(logDebug, String({"Snapshot created: ", path}));
+			} else {
+				//created by other process
+				nftw(tmpPath.c_str(),&walkClear,20,FTW_DEPTH|FTW_PHYS|FTW_MOUNT);
+			}
+		}
+		int fd = open(lockPath.c_str(), O_RDONLY|O_CLOEXEC);
+		if (fd < 0) continue;
+		flock(fd, LOCK_SH);
+		struct stat locked, current;
+		if (fstat(fd, &locked) == 0 && stat(lockPath.c_str(), &current) == 0
+				&& locked.st_ino == current.st_ino && locked.st_dev == current.st_dev) {
+			snapshotLock = fd;
+			snapshotPath = path;
+			return;
+		}
+		//removed while the lock has been acquired
+		close(fd);
+	}
+	throw std::runtime_error(String({"Unable to create snapshot of the shared code: ", path}).c_str());
+}
+
+void ModuleCompiler::releaseSnapshot() const {
+	if (snapshotLock < 0) return;
+	close(snapshotLock);
+	snapshotLock = -1;
+	String path = snapshotPath;
+	snapshotPath = String();
+	collectSnapshot(path);
+}
+
+Command ModuleCompiler::sourceCommand() const {
+	Command cmd(gccPath);
+	//the source is compiled in the environment, the shared code is found in the snapshot
+	if (!snapshotPath.empty()) cmd.arg("-iquote").arg(snapshotPath);
+	cmd.opts(gccOpts);
+	return cmd;
+}
+
+String ModuleCompiler::prepareEnv() const {
+	if (envPath.empty()) {
+		pid_t curPid = getpid();
+		String pidStr = Value(curPid).toString();
+		envPath = String({cachePath,"/",pidStr});
+		mkdir(envPath.c_str(),0777);
+		logOut(logDebug, String({"Environment prepared at: ", envPath}));
+	} else if (envCode.isCopyOf(sharedCode) || envCode == sharedCode) {
+		return envPath;
+	}
+
+	releaseSnapshot();
+	envCode = Value();
+	acquireSnapshot();
+	envCode = sharedCode;
+
+	return envPath;
+}
+
+
+void ModuleCompiler::removeEnv() const {
+	releaseSnapshot();
 	if (envPath.empty()) return;
 
 	nftw(envPath.c_str(),&walkClear,20,FTW_DEPTH|FTW_PHYS|FTW_MOUNT);
-	logOut(String({"Environment dropped at: ", envPath}));
+	logOut(logDebug, String({"Environment dropped at: ", envPath}));
 	envPath = String();
+	envCode = Value();
+}
+
+void ModuleCompiler::dropEnv() {
+	removeEnv();
 }
 
 ModuleCompiler::~ModuleCompiler() {
+	if (bgThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> _(bgLock);
+			bgStop = true;
+			bgCond.notify_one();
+		}
+		bgThread.join();
+	}
 	dropEnv();
 }
 
@@ -384,16 +1008,17 @@ int ModuleCompiler::compileFromFile(String file, bool moveToCache) {
 	}
 
 
-	String cmdLine({
-		gccPath, " ",
-		gccOpts, " ",
-		" -o ", tmpObj,
-		" ", tmpSrc,
-		" ",src.libraries,
-		" ",gccLibs});
+	Command cmd = Command(gccPath)
+			.opts(gccOpts)
+			.arg("-o").arg(tmpObj)
+			.arg(tmpSrc)
+			.opts(src.libraries)
+			.opts(gccLibs);
 
-	logOut(cmdLine);
-	int res = system(cmdLine.c_str());
+	logOut(cmd.toString());
+	std::string output;
+	int res = cmd.run(output, timeout);
+	std::cerr << output;
 	if (res == 0) {
 		try {
 			Module testOpen(tmpObj);
@@ -418,12 +1043,22 @@ static int clearCacheWalk(const char *fname, const struct stat *, int type, stru
 	if (ftw->level == 0) {
 		return FTW_CONTINUE;
 	} else if (type == FTW_D) {
+		StrViewA baseName(fname +ftw->base);
+		if (baseName.substr(0,4) == "mod_") {
+			logOut(logDebug, String({"Removed profile: ", fname}));
+			nftw(fname,&walkClear,20,FTW_DEPTH|FTW_PHYS|FTW_MOUNT);
+			return FTW_SKIP_SUBTREE;
+		}
+		if (baseName.substr(0,4) == "lib_") {
+			collectSnapshot(fname);
+			return FTW_SKIP_SUBTREE;
+		}
 		long pid = strtol(fname,0,10);
 		if (pid) {
 			bool ok = kill(pid,0) == 0;
 			if (!ok && errno != ESRCH) ok = true;
 			if (!ok) {
-				logOut(String({"Removing no longer used environment: ", fname}));
+				logOut(logDebug, String({"Removing no longer used environment: ", fname}));
 				nftw(fname,&walkClear,20,0);
 			}
 		}
@@ -431,7 +1066,7 @@ static int clearCacheWalk(const char *fname, const struct stat *, int type, stru
 	} else {
 		StrViewA baseName(fname +ftw->base);
 		if (baseName.substr(0,4) == "mod_") {
-			logOut(String({"Removed cached module: ", fname}));
+			logOut(logDebug, String({"Removed cached module: ", fname}));
 			remove(fname);
 		}
 		return  FTW_CONTINUE;
@@ -6,29 +6,61 @@
  */
 
 #pragma once
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include "parts/common.h"
 
 typedef IProc *(*EntryPoint)();
+typedef IFusedMap *(*FusedEntryPoint)();
+typedef void (*ProfileDump)();
+typedef ProfileDump (*GetProfileDump)();
+typedef int (*GetModuleFlags)();
 
 class Module: public json::RefCntObj {
 public:
-	Module(String path);
+	Module(String path, std::size_t hash = 0);
 	~Module();
 
 	IProc *getProc() const {return proc;}
+	///Returns fused map functions, or nullptr, if the module is not fused
+	IFusedMap *getFusedMap() const {return fused;}
 	const String getPath() const {return path;}
+	///Hash of the source code (or zero, if not known)
+	std::size_t getHash() const {return hash;}
+	///Time when the module has been loaded
+	time_t getLoadTime() const {return loadTime;}
+
+	///Flags of the module (see ModuleFlags)
+	int getFlags() const {return flags;}
+
+	///Returns true, if the module is instrumented and collects a profile
+	bool isProfiling() const {return profileDump != nullptr;}
+	///Writes collected profile. The module stops to be profiling after this call
+	void dumpProfile();
 
 protected:
 
 	void *libHandle;
 	IProc *proc;
+	IFusedMap *fused;
 	String path;
+	std::size_t hash;
+	time_t loadTime;
+	ProfileDump profileDump;
+	int flags;
 };
 
 
 typedef RefCntPtr<Module> PModule;
 
+class Command;
+
 void logOut(const StrViewA & msg);
+void logOut(LogLevel level, const StrViewA & msg);
 
 class ModuleCompiler {
 public:
@@ -38,7 +70,8 @@ public:
 		String sourceCode;
 		///Linker libraries
 		String libraries;
-
+		///Source requests profile guided optimization (//!pgo)
+		bool pgo = false;
 
 	};
 
@@ -47,20 +80,107 @@ public:
 
 	PModule compile(StrViewA code) const;
 
+	///Compiles the code into the cache without loading the module
+	/**
+	 * @param code source code of the function
+	 * @return path to the compiled module in the cache
+	 *
+	 * @note The function can be called from multiple threads, however the environment
+	 * must be prepared by prepareEnv() before the threads are started
+	 */
+	String build(StrViewA code) const;
+
+	static String getModuleName(std::size_t hash);
+
 	static SourceInfo createSource(StrViewA code, String lineMarkerFile) ;
+	///Retrieves request fields declared by the directive //!cache
+	/**
+	 * @param code source code of the function
+	 * @return array of names of the fields, or undefined, if the function doesn't allow caching
+	 */
+	static Value getCacheFields(StrViewA code);
+	///Creates source of the module, which contains map functions of multiple views
+	static SourceInfo createFusedSource(const std::vector<StrViewA> &codes);
+
+	///Compiles map functions of multiple views into single module
+	/**
+	 * The module is built in the background. Once it is finished, it is reported by takeFinished().
+	 * When the views can't be compiled together, the hash of the module is reported by takeFailed()
+	 *
+	 * @param codes source codes of the map functions
+	 * @return path to the module, if it is already in the cache, otherwise empty string.
+	 * Use Module::getFusedMap() to access the functions
+	 * @exception CompileError views can't be compiled together
+	 */
+	String buildFused(const std::vector<StrViewA> &codes) const;
+	///Calculates hash of the fused module
+	std::size_t calcFusedHash(const std::vector<StrViewA> &codes) const;
 
 	std::size_t calcHash(const StrViewA code) const;
 
 
+	///Sets the shared code
+	/**
+	 * The environment is not touched. It is rebuilt by prepareEnv() only when the shared code
+	 * differs from the code written to the environment
+	 */
 	void setSharedCode(Value sharedCode);
 
 
+	///Prepares the environment
+	/**
+	 * The environment is a directory of the process where the modules are built. The shared
+	 * code is materialized once per content into an immutable snapshot "lib_<hash>" in the cache,
+	 * which is shared by all processes. Each process holds a shared lock of the snapshot it uses.
+	 * Unused snapshots are removed when a process switches to other shared code and
+	 * by clearCache()
+	 *
+	 * @return path to the environment
+	 */
 	String prepareEnv() const;
 	void dropEnv();
 
 	int compileFromFile(String file, bool moveToCache);
 	void clearCache();
 
+	const String &getCachePath() const {return cachePath;}
+
+	///Sets timeout of the compiler in seconds (0 - no timeout)
+	void setTimeout(unsigned int timeout);
+
+	///Enables tiered compilation
+	/**
+	 * New functions are built with quick options first, so they can be used immediately. The
+	 * module built with the standard options is built in the background and reported
+	 * by takeFinished() once it is ready.
+	 *
+	 * @param quickOpts options used for the quick build. Set empty to disable tiered compilation
+	 */
+	void setQuick(String quickOpts);
+
+	///Enables profile guided optimization for functions marked by //!pgo
+	/**
+	 * @param generateOpts options to build instrumented module
+	 * @param useOpts options to build module using collected profile
+	 */
+	void setPGO(String generateOpts, String useOpts);
+	///Starts optimization of the module using collected profile
+	/**
+	 * The module is built in the background. Once it is finished, it is reported by takeFinished()
+	 * @param hash hash of the module
+	 */
+	void rebuildWithProfile(std::size_t hash) const;
+	///Retrieves modules finished in the background
+	/**
+	 * @param fn function called for every finished module with the hash and the path to the module
+	 */
+	void takeFinished(std::function<void(std::size_t, const String &)> fn) const;
+	///Retrieves fused modules, which failed to compile in the background
+	/**
+	 * @param fn function called for every failed module with the hash of the module
+	 */
+	void takeFailed(std::function<void(std::size_t)> fn) const;
+
 protected:
 	String cachePath;
 	String gccPath;
@@ -69,9 +189,39 @@ protected:
 	mutable String envPath;
 
 	Value sharedCode;
+	///shared code of the current snapshot
+	mutable Value envCode;
+	///path to the snapshot of the shared code (empty, if there is no shared code)
+	mutable String snapshotPath;
+	///descriptor holding the shared lock of the snapshot
+	mutable int snapshotLock = -1;
 
 	bool keepSource;
 
+	String pgoGenerate;
+	String pgoUse;
+	String quickOpts;
+	unsigned int timeout = 0;
+
+	void removeEnv() const;
+	void acquireSnapshot() const;
+	void releaseSnapshot() const;
+	///Creates command running the compiler over the source in the environment
+	Command sourceCommand() const;
+
+	mutable std::mutex bgLock;
+	mutable std::condition_variable bgCond;
+	mutable std::deque<std::function<void()> > bgQueue;
+	mutable std::vector<std::pair<std::size_t, String> > bgFinished;
+	mutable std::vector<std::size_t> bgFailed;
+	mutable std::map<std::size_t, String> pgoLibs;
+	mutable std::set<std::size_t> bgPending;
+	mutable std::thread bgThread;
+	bool bgStop = false;
+
+	String buildQuick(std::size_t hash, const String &envSrcPath, const String &libraries) const;
+	String buildInstrumented(std::size_t hash, const String &envSrcPath, const String &libraries) const;
+	void runInBackground(std::function<void()> job) const;
 };
 
 class CompileError: public std::runtime_error {
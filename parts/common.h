@@ -6,14 +6,22 @@
 #include "../api.h"
 
 
+///Flags of the module, reported by the function getModuleFlags() of the module
+enum ModuleFlags {
+	///Results of reduce() and rereduce() can be cached (//!memoize)
+	flagMemoize = 1
+};
+
 class IProc {
 public:
 
 	typedef std::function<void(const Value &key, const Value &value)> EmitFn;
-	typedef std::function<void(const StrViewA &string)> LogFn;
+	typedef std::function<void(LogLevel level, const StrViewA &string)> LogFn;
 	typedef std::function<Value()> GetRowFn;
 	typedef std::function<void(const StrViewA &)> SendFn;
 	typedef std::function<void(const Value &)> StartFn;
+	typedef std::function<void(const BinaryView &)> SendBinaryFn;
+	typedef std::function<void(const Value &)> SetBodyFn;
 
 
 	///Map document to the view
@@ -28,6 +36,9 @@ public:
 	 *   receive Row items. Each Row item has following member fields: key, value, docId
 	 * @return reduced value
 	 *
+	 * @note the rows can be decoded by the server in advance. Don't keep the RowSet or its
+	 * iterators after the function returns
+	 *
 	 */
 	virtual Value reduce(RowSet rows) = 0;
 	///Rereduce multiple reduced results
@@ -74,6 +85,9 @@ public:
 	 * start() must be called as the first, otherwise it is ignored. If start is not called, the default headers
 	 * are used.
 	 *
+	 * Use DocumentEdit to make multiple changes of the document. It keeps the document untouched
+	 * when nothing has changed.
+	 *
 	 */
 	virtual void update(Document &doc, Value request) = 0;
 
@@ -106,11 +120,41 @@ public:
 	virtual void initEmit(EmitFn fn) = 0;
 	virtual void initLog(LogFn fn) = 0;
 	virtual void initShowListFns(GetRowFn getrow, SendFn send, StartFn start) = 0;
+	///Sets functions which create the body of response of show() and update()
+	/**
+	 * @param sendBinary appends binary data to the body. The body is then transferred as base64
+	 * @param setJSON sets JSON value as the body
+	 */
+	virtual void initBodyFns(SendBinaryFn sendBinary, SetBodyFn setJSON) = 0;
 
 	virtual ~IProc() {}
 };
 
-class AbstractProc: public IProc {
+///Map functions of multiple views compiled into single module
+/**
+ * The module is built by the query server when the option "fuseViews" is enabled. Single call
+ * of mapdoc() runs map functions of all views
+ */
+class IFusedMap {
+public:
+
+	typedef std::function<void(unsigned int view, const Value &key, const Value &value)> EmitFn;
+
+	///Maps the document to all views
+	virtual void mapdoc(Document doc) = 0;
+	///Returns count of views
+	virtual unsigned int getViewCount() const = 0;
+
+	virtual void onClose() = 0;
+
+	///Sets emit function. The first argument of the function is index of the view
+	virtual void initEmit(EmitFn fn) = 0;
+	virtual void initLog(IProc::LogFn fn) = 0;
+
+	virtual ~IFusedMap() {}
+};
+
+class COUCHCPP_API AbstractProc: public IProc {
 
 	///Function emit
 	/** The function is available only for mapdoc function
@@ -133,6 +177,7 @@ class AbstractProc: public IProc {
 	 *
 	 * @code
 	 * void log(StrViewA text)
+	 * void log(LogLevel level, StrViewA text)
 	 * @endcode
 	 *
 	 * Sends text to couchdb's log. Whole line must be send (it cannot be send per-partes)
@@ -181,6 +226,26 @@ class AbstractProc: public IProc {
 
 	SendFn fn_send;
 
+	///Function sends binary data to the output
+	/**
+	 * The function is available in update() and show()
+	 *
+	 * @code
+	 * void sendBinary(BinaryView data);
+	 * @endcode
+	 */
+	SendBinaryFn fn_sendBinary;
+
+	///Function sets JSON value as the body of the response
+	/**
+	 * The function is available in update() and show()
+	 *
+	 * @code
+	 * void setJSONBody(Value body);
+	 * @endcode
+	 */
+	SetBodyFn fn_setJSONBody;
+
 
 	Array rowBuffer;
 
@@ -212,13 +277,19 @@ public:
 	/**
 	 * @param msg message which appears in log
 	 */
-	inline void log(StrViewA msg) {fn_log(msg);}
+	inline void log(StrViewA msg) {fn_log(logInfo, msg);}
+	///Send text to the log with given level
+	/**
+	 * @param level level of the message
+	 * @param msg message which appears in log
+	 */
+	inline void log(LogLevel level, StrViewA msg) {fn_log(level, msg);}
 	///Send message and object to the log
 	/**
 	 * @param msg message which appears in log
 	 * @param data object which appears in log
 	 */
-	inline void log(StrViewA msg, json::Value data) {fn_log(String({msg,data.toString()}));}
+	void log(StrViewA msg, json::Value data);
 
 	///Receive next row from the current rowset
 	/**
@@ -261,9 +332,7 @@ public:
 	 * @param headers headers as object key-value
 	 * @param code status code;
 	 */
-	inline void start(json::Value headers, int code = 200) {
-		fn_start(Object("code",code)("headers",headers));
-	}
+	void start(json::Value headers, int code = 200);
 	///Send text to the output
 	/**
 	 * @param str text to send
@@ -274,47 +343,48 @@ public:
 	 *
 	 * @param json json to send
 	 */
-	inline void sendJSON(const json::Value json) {fn_send(json.stringify());}
+	void sendJSON(const json::Value json);
+	///Send binary data to the output
+	/**
+	 * Data are appended to the body of the response, which is then transferred as base64. Text
+	 * sent by send() is also part of the binary body.
+	 *
+	 * @param data data to send
+	 *
+	 * @note the function is available only in show() and update() functions
+	 */
+	inline void sendBinary(BinaryView data) {fn_sendBinary(data);}
+	///Sets already built JSON value as the body of the response
+	/**
+	 * The value is passed to the server without serialization to text. It replaces content
+	 * sent by send() and sendBinary()
+	 *
+	 * @param body body of the response
+	 *
+	 * @note the function is available only in show() and update() functions
+	 */
+	inline void setJSONBody(const json::Value &body) {fn_setJSONBody(body);}
 
 
 
-	virtual void mapdoc(Document ) override{
-		throw std::runtime_error("Function 'void mapdoc(Document)' is not defined");
-	}
-	virtual Value reduce(RowSet rows) override {
-		throw std::runtime_error("Function 'Value reduce(RowSet rows)' is not defined");
-	}
-	virtual Value rereduce(Value ) override {
-		throw std::runtime_error("Function 'Value rereduce(Value)' is not defined");
-	}
+	virtual void mapdoc(Document ) override;
+	virtual Value reduce(RowSet rows) override;
+	virtual Value rereduce(Value ) override;
 
-	virtual void show(Document , Value ) override{
-		throw std::runtime_error("Function 'void show(Document doc, Value request)' is not defined");
-	}
-	virtual void list(Value , Value ) override{
-		throw std::runtime_error("Function 'void list(Value head, Value request)' is not defined");
-	}
-	virtual void update(Document &, Value ) override{
-		throw std::runtime_error("Function 'void update(Document &doc, Value request)' is not defined");
-	}
-	virtual bool filter(Document , Value ) override{
-		throw std::runtime_error("Function 'bool filter(Document doc, Value request)' is not defined");
-	}
-	virtual ValidationResult validate(Document , Context )override {
-		throw std::runtime_error("Function 'ValidationResult validate(Document doc, Context context)' is not defined");
-	};
+	virtual void show(Document , Value ) override;
+	virtual void list(Value , Value ) override;
+	virtual void update(Document &, Value ) override;
+	virtual bool filter(Document , Value ) override;
+	virtual ValidationResult validate(Document , Context )override;
 
 
-	virtual void onClose()override {delete this;}
+	virtual void onClose()override;
 
 
-	virtual void initEmit(EmitFn fn) {fn_emit = fn;}
-	virtual void initLog(LogFn fn) {fn_log = fn;}
-	virtual void initShowListFns(GetRowFn getrow, SendFn send, StartFn start) {
-		this->fn_getRow = getrow;
-		this->fn_send = send;
-		this->fn_start = start;
-	}
+	virtual void initEmit(EmitFn fn);
+	virtual void initLog(LogFn fn);
+	virtual void initShowListFns(GetRowFn getrow, SendFn send, StartFn start);
+	virtual void initBodyFns(SendBinaryFn sendBinary, SetBodyFn setJSON);
 };
 
 
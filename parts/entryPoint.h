@@ -5,3 +5,21 @@ __attribute__ ((visibility ("default"))) IProc *initProc() {
 		return new Proc;
 	}
 }
+
+#ifdef __COUCHCPP_PROFILE
+extern "C" {
+void __gcov_dump() __attribute__((weak));
+///Returns function which writes collected profile, or nullptr, if the module is not instrumented
+__attribute__ ((visibility ("default"))) void (*getProfileDump())() {
+		return &__gcov_dump;
+	}
+}
+#endif
+
+#ifdef __COUCHCPP_FLAGS
+extern "C" {
+__attribute__ ((visibility ("default"))) int getModuleFlags() {
+		return __COUCHCPP_FLAGS;
+	}
+}
+#endif
@@ -0,0 +1,390 @@
+/*
+ * pool.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include "pool.h"
+#include "jsonreader.h"
+#include "module.h"
+
+///Stream buffer over a file descriptor (pipe)
+/**
+ * When the deadline is set, reading and writing fail after the deadline
+ */
+class FdStreamBuf: public std::streambuf {
+public:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	FdStreamBuf(int fd):fd(fd) {
+		setg(ibuf, ibuf, ibuf);
+		setp(obuf, obuf+sizeof(obuf));
+	}
+	~FdStreamBuf() {
+		sync();
+		close(fd);
+	}
+
+	int getFd() const {return fd;}
+
+	///Sets the deadline of following operations
+	void setDeadline(TimePoint tp) {deadline = tp; hasDeadline = true;}
+	///Returns true, if an operation failed, because the deadline expired
+	bool isExpired() const {return expired;}
+
+protected:
+	int fd;
+	char ibuf[4096];
+	char obuf[4096];
+	TimePoint deadline;
+	bool hasDeadline = false;
+	bool expired = false;
+
+	///Waits until the pipe is ready, returns false when the deadline expires
+	bool wait(short events) {
+		if (!hasDeadline) return true;
+		for(;;) {
+			auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			if (remain.count() <= 0) {
+				expired = true;
+				return false;
+			}
+			pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = events;
+			pfd.revents = 0;
+			int p = poll(&pfd, 1, (int)remain.count());
+			if (p > 0) return true;
+			if (p < 0 && errno != EINTR) return false;
+		}
+	}
+
+	virtual int_type underflow() override {
+		ssize_t n;
+		do {
+			if (!wait(POLLIN)) return traits_type::eof();
+			n = read(fd, ibuf, sizeof(ibuf));
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0) return traits_type::eof();
+		setg(ibuf, ibuf, ibuf+n);
+		return traits_type::to_int_type(*ibuf);
+	}
+	virtual int_type overflow(int_type c) override {
+		if (sync()) return traits_type::eof();
+		if (c != traits_type::eof()) {
+			*pptr() = (char)c;
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+	virtual int sync() override {
+		char *p = pbase();
+		while (p < pptr()) {
+			if (!wait(POLLOUT)) return -1;
+			ssize_t n = write(fd, p, pptr()-p);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return -1;
+			p += n;
+		}
+		setp(obuf, obuf+sizeof(obuf));
+		return 0;
+	}
+};
+
+static Value crashError() {
+	return {"error","worker_crash","The worker process has crashed while processing the command"};
+}
+
+static Value timeoutError() {
+	return {"error","worker_timeout","The worker process has not finished the command in time and it has been terminated"};
+}
+
+struct WorkerPool::Worker {
+	pid_t pid = 0;
+	std::unique_ptr<FdStreamBuf> inbuf, outbuf;
+	std::unique_ptr<std::istream> in;
+	std::unique_ptr<std::ostream> out;
+	std::unique_ptr<JSONReader> reader;
+};
+
+WorkerPool::WorkerPool(unsigned int count, unsigned int timeout, WorkerMain workerMain, ClientWrite clientWrite, ClientRead clientRead)
+	:timeout(timeout)
+	,workerMain(workerMain)
+	,clientWrite(clientWrite)
+	,clientRead(clientRead)
+{
+	//writing to a crashed worker must not kill the protocol process
+	signal(SIGPIPE, SIG_IGN);
+	for (unsigned int i = 0; i < count; i++) {
+		workers.push_back(PWorker(new Worker));
+		start(*workers.back());
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	//closing pipes causes that workers exit
+	for (auto &&w: workers) {
+		w->out.reset();
+		w->outbuf.reset();
+	}
+	for (auto &&w: workers) {
+		if (w->pid) waitpid(w->pid, nullptr, 0);
+	}
+}
+
+void WorkerPool::start(Worker &w) {
+	int toWorker[2], fromWorker[2];
+	if (pipe(toWorker)) throw std::runtime_error("Unable to create pipe");
+	if (pipe(fromWorker)) {
+		close(toWorker[0]);
+		close(toWorker[1]);
+		throw std::runtime_error("Unable to create pipe");
+	}
+	std::cout.flush();
+	pid_t pid = fork();
+	if (pid == -1) {
+		close(toWorker[0]);close(toWorker[1]);
+		close(fromWorker[0]);close(fromWorker[1]);
+		throw std::runtime_error("Unable to start worker");
+	}
+	if (pid == 0) {
+		close(toWorker[1]);
+		close(fromWorker[0]);
+		for (auto &&x: workers) {
+			//the worker must not keep pipes of other workers open
+			if (x->inbuf) close(x->inbuf->getFd());
+			if (x->outbuf) close(x->outbuf->getFd());
+		}
+		//the worker must not touch the protocol pipes
+		int devnull = open("/dev/null", O_RDONLY);
+		dup2(devnull, 0);
+		close(devnull);
+		dup2(2, 1);
+		{
+			FdStreamBuf inbuf(toWorker[0]), outbuf(fromWorker[1]);
+			std::istream in(&inbuf);
+			std::ostream out(&outbuf);
+			workerMain(in, out);
+		}
+		_exit(0);
+	}
+	close(toWorker[0]);
+	close(fromWorker[1]);
+	w.pid = pid;
+	w.inbuf.reset(new FdStreamBuf(fromWorker[0]));
+	w.outbuf.reset(new FdStreamBuf(toWorker[1]));
+	w.in.reset(new std::istream(w.inbuf.get()));
+	w.out.reset(new std::ostream(w.outbuf.get()));
+	w.reader.reset(new JSONReader(*w.in));
+	logOut(logDebug, String({"Worker started: ", Value(pid).toString()}));
+}
+
+void WorkerPool::stop(Worker &w) {
+	if (w.pid == 0) return;
+	kill(w.pid, SIGKILL);
+	waitpid(w.pid, nullptr, 0);
+	if (expired(w)) logOut(logWarning, String({"Worker timed out and has been killed: ", Value(w.pid).toString()}));
+	else logOut(logWarning, String({"Worker crashed: ", Value(w.pid).toString()}));
+	w.reader.reset();
+	w.in.reset();
+	w.out.reset();
+	w.inbuf.reset();
+	w.outbuf.reset();
+	w.pid = 0;
+}
+
+WorkerPool::Worker &WorkerPool::ready(Worker &w) {
+	if (w.pid) return w;
+	start(w);
+	for (auto &&d: ddocs) {
+		send(w, d.second);
+		receive(w);
+	}
+	for (auto &&c: session) {
+		send(w, c);
+		receive(w);
+	}
+	return w;
+}
+
+void WorkerPool::send(Worker &w, const Value &cmd) {
+	//the deadline covers sending of the command and receiving of the response
+	if (timeout) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+		w.inbuf->setDeadline(deadline);
+		w.outbuf->setDeadline(deadline);
+	}
+	cmd.toStream(*w.out);
+	*w.out << std::endl;
+	if (!*w.out) throw Crashed(w, expired(w));
+}
+
+Value WorkerPool::receive(Worker &w) {
+	for(;;) {
+		Value v;
+		try {
+			v = w.reader->read();
+		} catch (...) {
+			throw Crashed(w, expired(w));
+		}
+		if (v[0].getString() == "log") clientWrite(v);
+		else return v;
+	}
+}
+
+bool WorkerPool::expired(const Worker &w) {
+	return (w.inbuf && w.inbuf->isExpired()) || (w.outbuf && w.outbuf->isExpired());
+}
+
+Value WorkerPool::failure(const Crashed &e) {
+	return e.expired?timeoutError():crashError();
+}
+
+WorkerPool::Worker &WorkerPool::pick() {
+	Worker &w = *workers[nextWorker];
+	nextWorker = (nextWorker + 1) % workers.size();
+	return ready(w);
+}
+
+Value WorkerPool::broadcast(const Value &cmd) {
+	Value res;
+	std::vector<Worker *> used;
+	for (auto &&w: workers) {
+		//a worker which is not running receives the state when it is started
+		if (w->pid == 0) continue;
+		try {
+			send(*w, cmd);
+			used.push_back(w.get());
+		} catch (Crashed &e) {
+			stop(e.w);
+		}
+	}
+	for (Worker *w: used) {
+		try {
+			Value r = receive(*w);
+			if (!res.defined() || r[0].getString() == "error") res = r;
+		} catch (Crashed &e) {
+			stop(e.w);
+		}
+	}
+	if (!res.defined()) {
+		Worker &w = pick();
+		send(w, cmd);
+		res = receive(w);
+	}
+	return res;
+}
+
+std::vector<Value> WorkerPool::split(Value items) {
+	std::vector<Value> out;
+	std::size_t cnt = items.size();
+	std::size_t parts = std::min(cnt, workers.size());
+	std::size_t pos = 0;
+	Array chunk;
+	for (Value x: items) {
+		chunk.push_back(x);
+		pos++;
+		if (pos == cnt * (out.size()+1) / parts) {
+			out.push_back(chunk);
+			chunk.clear();
+		}
+	}
+	return out;
+}
+
+Value WorkerPool::scatter(const std::vector<Value> &cmds) {
+	std::vector<Worker *> used;
+	Value failed;
+	for (auto &&c: cmds) {
+		try {
+			Worker &w = pick();
+			send(w, c);
+			used.push_back(&w);
+		} catch (Crashed &e) {
+			stop(e.w);
+			failed = failure(e);
+		}
+	}
+	Array results;
+	Value err;
+	//receive all responses, even if some worker failed, to keep workers in sync
+	for (Worker *w: used) {
+		try {
+			Value r = receive(*w);
+			if (r[0].getBool() != true) err = r;
+			else for (Value x: r[1]) results.push_back(x);
+		} catch (Crashed &e) {
+			stop(e.w);
+			failed = failure(e);
+		}
+	}
+	if (failed.defined()) return failed;
+	if (err.defined()) return err;
+	return {true, results};
+}
+
+Value WorkerPool::relayList(const Value &cmd) {
+	Worker &w = pick();
+	send(w, cmd);
+	for(;;) {
+		Value r = receive(w);
+		StrViewA t = r[0].getString();
+		if (t == "start" || t == "chunks") {
+			clientWrite(r);
+			send(w, clientRead());
+		} else {
+			return r;
+		}
+	}
+}
+
+Value WorkerPool::process(const Value &cmd) {
+	try {
+		StrViewA c = cmd[0].getString();
+		if (c == "reset") {
+			session.clear();
+			return broadcast(cmd);
+		} else if (c == "add_lib" || c == "add_fun") {
+			Value r = broadcast(cmd);
+			session.push_back(cmd);
+			return r;
+		} else if (c == "reduce" || c == "rereduce") {
+			std::vector<Value> cmds;
+			for (Value fns: split(cmd[1])) cmds.push_back({c, fns, cmd[2]});
+			if (cmds.empty()) return {true, json::array};
+			return scatter(cmds);
+		} else if (c == "ddoc") {
+			if (cmd[1].getString() == "new") {
+				Value r = broadcast(cmd);
+				ddocs[String(cmd[2])] = cmd;
+				return r;
+			}
+			StrViewA callType = cmd[2][0].getString();
+			if (callType == "filters" || callType == "views") {
+				Value args = cmd[3];
+				std::vector<Value> cmds;
+				for (Value docs: split(args[0])) {
+					cmds.push_back({"ddoc", cmd[1], cmd[2], {docs, args[1]}});
+				}
+				if (cmds.empty()) return {true, json::array};
+				return scatter(cmds);
+			} else if (callType == "lists") {
+				return relayList(cmd);
+			}
+		}
+		Worker &w = pick();
+		send(w, cmd);
+		return receive(w);
+	} catch (Crashed &e) {
+		stop(e.w);
+		return failure(e);
+	}
+}
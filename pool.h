@@ -0,0 +1,102 @@
+/*
+ * pool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Pool of worker processes which execute the user code
+/**
+ * Each worker is a forked copy of the query server, which speaks the same protocol through
+ * a pair of pipes. The pool forwards the state (add_lib, add_fun, ddoc new) to all workers,
+ * spreads batches (filters, reduce functions) over the workers and relays lists.
+ *
+ * When a worker crashes, the command returns an error and the worker is started again
+ * and receives the state before it is used next time. Other workers and the protocol
+ * process are not affected. A worker, which doesn't finish the command in time, is killed
+ * and handled the same way.
+ *
+ * @note the pool must be created before any thread is started in the process, because
+ * workers are forked.
+ */
+class WorkerPool {
+public:
+	///Function which runs the query server in the worker
+	typedef std::function<void(std::istream &in, std::ostream &out)> WorkerMain;
+	///Function which sends a message to CouchDB
+	typedef std::function<void(const Value &)> ClientWrite;
+	///Function which reads a message from CouchDB
+	typedef std::function<Value()> ClientRead;
+
+	///Constructor
+	/**
+	 * @param count count of workers
+	 * @param timeout timeout of a command in seconds (0 - no timeout). The time spent by
+	 * waiting for CouchDB during a list is not counted
+	 * @param workerMain function which runs the query server in the worker
+	 * @param clientWrite function which sends a message to CouchDB
+	 * @param clientRead function which reads a message from CouchDB
+	 */
+	WorkerPool(unsigned int count, unsigned int timeout, WorkerMain workerMain, ClientWrite clientWrite, ClientRead clientRead);
+	~WorkerPool();
+
+	///Processes the command and returns the response
+	Value process(const Value &cmd);
+
+protected:
+
+	struct Worker;
+	typedef std::unique_ptr<Worker> PWorker;
+
+	class Crashed {
+	public:
+		Crashed(Worker &w, bool expired):w(w),expired(expired) {}
+		Worker &w;
+		///the worker has been stopped, because the timeout expired
+		bool expired;
+	};
+
+	std::vector<PWorker> workers;
+	unsigned int timeout;
+	WorkerMain workerMain;
+	ClientWrite clientWrite;
+	ClientRead clientRead;
+	std::size_t nextWorker = 0;
+
+	///add_lib and add_fun since the last reset
+	std::vector<Value> session;
+	///ddoc new commands
+	std::map<String, Value> ddocs;
+
+	void start(Worker &w);
+	void stop(Worker &w);
+	Worker &ready(Worker &w);
+	void send(Worker &w, const Value &cmd);
+	Value receive(Worker &w);
+	Worker &pick();
+	static bool expired(const Worker &w);
+	static Value failure(const Crashed &e);
+
+	Value broadcast(const Value &cmd);
+	Value scatter(const std::vector<Value> &cmds);
+	std::vector<Value> split(Value items);
+	///Relays the list function between the worker and CouchDB
+	/**
+	 * When the worker fails after "start" or "chunks" has been relayed, CouchDB receives
+	 * the error instead of the next "chunks" or "end". CouchDB has already sent the
+	 * headers and part of the body, so the client receives a truncated response. The
+	 * next command starts in sync, because the message of CouchDB is read only after
+	 * the worker has answered.
+	 */
+	Value relayList(const Value &cmd);
+};
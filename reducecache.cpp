@@ -0,0 +1,95 @@
+/*
+ * reducecache.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <cstring>
+#include <imtjson/fnv.h>
+#include "reducecache.h"
+
+typedef FNV1a<sizeof(std::size_t)> Hasher;
+
+static void hashBytes(Hasher &h, const void *data, std::size_t len) {
+	const unsigned char *c = reinterpret_cast<const unsigned char *>(data);
+	for (std::size_t i = 0; i < len; i++) h(c[i]);
+}
+
+///Calculates hash of the value without serialization
+static void hashValue(Hasher &h, const Value &v) {
+	ValueType t = v.type();
+	h((int)t);
+	switch (t) {
+	case json::number: {
+		double d = v.getNumber();
+		hashBytes(h, &d, sizeof(d));
+		break;
+	}
+	case json::string: {
+		StrViewA s = v.getString();
+		hashBytes(h, s.data, s.length);
+		break;
+	}
+	case json::boolean:
+		h(v.getBool()?1:0);
+		break;
+	case json::array:
+	case json::object: {
+		std::size_t sz = v.size();
+		hashBytes(h, &sz, sizeof(sz));
+		for (Value x: v) {
+			StrViewA k = x.getKey();
+			hashBytes(h, k.data, k.length);
+			hashValue(h, x);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+ReduceCache::ReduceCache(std::size_t maxEntries):maxEntries(maxEntries) {}
+
+std::size_t ReduceCache::makeKey(std::size_t fnHash, bool rereduce, const Value &input) {
+	std::size_t h;
+	Hasher hash(h);
+	hashBytes(hash, &fnHash, sizeof(fnHash));
+	hash(rereduce?1:0);
+	hashValue(hash, input);
+	return h;
+}
+
+bool ReduceCache::find(std::size_t key, const Value &input, Value &result) {
+	auto iter = entries.find(key);
+	if (iter == entries.end() || iter->second.input != input) {
+		misses++;
+		return false;
+	}
+	lru.splice(lru.begin(), lru, iter->second.lru);
+	result = iter->second.result;
+	hits++;
+	return true;
+}
+
+void ReduceCache::store(std::size_t key, const Value &input, const Value &result) {
+	auto iter = entries.find(key);
+	if (iter != entries.end()) {
+		lru.erase(iter->second.lru);
+		entries.erase(iter);
+	}
+	while (!lru.empty() && entries.size() >= maxEntries) {
+		entries.erase(lru.back());
+		lru.pop_back();
+	}
+	lru.push_front(key);
+	Entry &e = entries[key];
+	e.input = input;
+	e.result = result;
+	e.lru = lru.begin();
+}
+
+Value ReduceCache::getStats() const {
+	return Object("hits",hits)("misses",misses)("entries",entries.size());
+}
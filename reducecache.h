@@ -0,0 +1,75 @@
+/*
+ * reducecache.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Bounded cache of results of reduce() and rereduce()
+/**
+ * The cache is used only for functions marked by //!memoize. The key is combined from
+ * the hash of the function and the hash of the input. The input is stored with the result
+ * and it is compared on hit, so a collision of hashes cannot return a wrong result.
+ * Least recently used entries are removed when the cache is full.
+ *
+ * The same cache keeps responses of show functions marked by //!cache. The input is then
+ * the document revision and the declared fields of the request.
+ */
+class ReduceCache {
+public:
+	///Constructor
+	/**
+	 * @param maxEntries maximum count of entries
+	 */
+	ReduceCache(std::size_t maxEntries);
+
+	///Calculates the key of the entry
+	/**
+	 * @param fnHash hash of the function
+	 * @param rereduce true for rereduce
+	 * @param input rows (reduce) or values (rereduce)
+	 * @return key for find() and store(). The input is hashed recursively, so calculate the
+	 * key once and use it for both calls
+	 */
+	static std::size_t makeKey(std::size_t fnHash, bool rereduce, const Value &input);
+
+	///Finds result in the cache
+	/**
+	 * @param key key returned by makeKey()
+	 * @param input rows (reduce) or values (rereduce)
+	 * @param result found result
+	 * @retval true found
+	 * @retval false not found
+	 */
+	bool find(std::size_t key, const Value &input, Value &result);
+	///Stores result to the cache
+	/**
+	 * @param key key returned by makeKey()
+	 * @param input rows (reduce) or values (rereduce)
+	 * @param result result to store
+	 */
+	void store(std::size_t key, const Value &input, const Value &result);
+
+	///Returns statistics (hits, misses, entries)
+	Value getStats() const;
+
+protected:
+	struct Entry {
+		Value input;
+		Value result;
+		std::list<std::size_t>::iterator lru;
+	};
+
+	std::size_t maxEntries;
+	std::unordered_map<std::size_t, Entry> entries;
+	std::list<std::size_t> lru;
+	std::size_t hits = 0;
+	std::size_t misses = 0;
+};
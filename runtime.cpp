@@ -0,0 +1,273 @@
+/*
+ * runtime.cpp
+ *
+ * Shared code of the modules. The library couchcpp_runtime is loaded once by the
+ * query server, so the modules don't need to carry their own copy of this code
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <algorithm>
+#include <imtjson/path.h>
+#include "parts/common.h"
+#include "jsonwriter.h"
+
+StrViewA Document::getDocType(char typeSep) const {
+	StrViewA id = getID();
+	std::size_t seppos = id.indexOf(StrViewA(&typeSep,1));
+	if (seppos == id.npos) return StrViewA();
+	else return id.substr(0,seppos);
+}
+
+Document Document::replace(const Path &path, const json::Value &val) const {
+	return Document(json::Value::replace(path,val));
+}
+
+Document Document::replace(const StrViewA &key, const json::Value &val) const {
+	return Document(json::Value::replace(json::Path::root/key,val));
+}
+
+String Document::getAttachmentUri(StrViewA name, Value userContext) const {
+	Value db = userContext["db"];
+	if (!db.defined()) {
+		db = userContext["userCtx"]["db"];
+	}
+	if (!db.defined()) {
+		throw std::runtime_error("getAttachmentUri - invalid 2. argument");
+	}
+	Value idenc = urlEncoding->encodeBinaryValue(BinaryView(getID()));
+	Value nameenc = urlEncoding->encodeBinaryValue(BinaryView(name));
+	return String({db.getString(),"/",idenc,"/",nameenc});
+}
+
+Document Document::setAttachment(StrViewA name, Value data) {
+	return replace(Path::root/"_attachments"/name, data);
+}
+
+BinaryView Document::getAttachmentData(StrViewA name, std::vector<unsigned char> &buffer) const {
+	Value data = getAttachment(name)["data"];
+	if (data.type() != json::string) return BinaryView();
+	StrViewA text = data.getString();
+	buffer.resize(base64DecodedSize(text));
+	std::size_t sz = base64Decode(text, buffer.data());
+	return BinaryView(buffer.data(), sz);
+}
+
+Document Document::setAttachmentData(StrViewA name, StrViewA contentType, BinaryView data) const {
+	return replace(Path::root/"_attachments"/name, Object("content_type", contentType)("data", base64Encode(data)));
+}
+
+///Returns true, if one path is prefix of the other one
+static bool pathOverlaps(const std::vector<String> &path, const StrViewA *keys, std::size_t count) {
+	std::size_t n = std::min(path.size(), count);
+	for (std::size_t i = 0; i < n; i++) {
+		if (StrViewA(path[i]) != keys[i]) return false;
+	}
+	return true;
+}
+
+DocumentEdit &DocumentEdit::set(const StrViewA *keys, std::size_t count, const Value &val) {
+	bool overlaps = false;
+	for (const Edit &e: edits) {
+		if (pathOverlaps(e.path, keys, count)) {
+			overlaps = true;
+			break;
+		}
+	}
+	if (!overlaps) {
+		//nothing changed on the path yet, compare with the document
+		Value cur = doc;
+		for (std::size_t i = 0; i < count && cur.defined(); i++) {
+			cur = cur.type() == json::object?cur[keys[i]]:Value();
+		}
+		if (cur.defined() == val.defined() && (!cur.defined() || cur == val)) return *this;
+	}
+	Edit e;
+	e.path.reserve(count);
+	for (std::size_t i = 0; i < count; i++) e.path.push_back(keys[i]);
+	e.value = val;
+	edits.push_back(std::move(e));
+	return *this;
+}
+
+bool DocumentEdit::changed(StrViewA key) const {
+	for (const Edit &e: edits) {
+		if (StrViewA(e.path[0]) == key) return true;
+	}
+	return false;
+}
+
+typedef std::vector<const DocumentEdit::Edit *> EditList;
+
+///Applies changes to the object. All changes share the path up to the level depth
+static Value applyEdits(const Value &orig, const EditList &edits, std::size_t depth) {
+	bool isobj = orig.type() == json::object;
+	if (!isobj) {
+		//there is nothing to remove in a value, which is not an object. Only setting a field creates the object
+		bool anySet = false;
+		for (const DocumentEdit::Edit *e: edits) {
+			if (e->value.defined()) {
+				anySet = true;
+				break;
+			}
+		}
+		if (!anySet) return orig;
+	}
+	Object obj(isobj?orig:Value(json::object));
+	std::vector<bool> done(edits.size(), false);
+	EditList sub;
+	for (std::size_t i = 0; i < edits.size(); i++) {
+		if (done[i]) continue;
+		StrViewA key = edits[i]->path[depth];
+		Value v = isobj?orig[key]:Value();
+		sub.clear();
+		for (std::size_t j = i; j < edits.size(); j++) {
+			const DocumentEdit::Edit *e = edits[j];
+			if (done[j] || StrViewA(e->path[depth]) != key) continue;
+			done[j] = true;
+			if (e->path.size() == depth+1) {
+				//the field is replaced, previous changes of nested fields are lost
+				v = e->value;
+				sub.clear();
+			} else {
+				sub.push_back(e);
+			}
+		}
+		if (!sub.empty()) v = applyEdits(v, sub, depth+1);
+		if (v.defined()) obj.set(key, v);
+		else obj.unset(key);
+	}
+	return obj.commit();
+}
+
+Document &DocumentEdit::commit() {
+	if (!edits.empty()) {
+		EditList lst;
+		lst.reserve(edits.size());
+		for (const Edit &e: edits) lst.push_back(&e);
+		doc = Document(applyEdits(doc, lst, 0));
+		edits.clear();
+	}
+	return doc;
+}
+
+static StrViewSet buildSet(Value arr) {
+	StrViewSet out;
+	for (Value v: arr) out.insert(v.getString());
+	return out;
+}
+
+NameRoleSet::NameRoleSet(Value section)
+	:names(buildSet(section["names"]))
+	,roles(buildSet(section["roles"]))
+{
+}
+
+SecurityIndex::SecurityIndex(Value security)
+	:security(security)
+	,admins(security["admins"])
+	,members(security["members"])
+{
+}
+
+UserIndex::UserIndex(Value user)
+	:user(user)
+	,name(user["name"].getString())
+	,roles(buildSet(user["roles"]))
+{
+}
+
+ContextData::ContextData(Document prevDoc,Value user,Value security)
+	:prevDoc(prevDoc),user(user),security(security)
+	,userIndex(new UserIndex(user))
+	,securityIndex(new SecurityIndex(security))
+{
+}
+
+ContextData::ContextData(Document prevDoc,RefCntPtr<const UserIndex> userIndex, RefCntPtr<const SecurityIndex> securityIndex)
+	:prevDoc(prevDoc),user(userIndex->user),security(securityIndex->security)
+	,userIndex(userIndex)
+	,securityIndex(securityIndex)
+{
+}
+
+bool ContextData::hasRole(StrViewA role) const {
+	return userIndex->roles.find(role) != userIndex->roles.end();
+}
+
+bool ContextData::anyRole(const StrViewSet &userRoles, const NameRoleSet &section) {
+	if (section.roles.empty()) return false;
+	for (const StrViewA &r: userRoles) {
+		if (section.roles.find(r) != section.roles.end()) return true;
+	}
+	return false;
+}
+
+bool ContextData::isAdmin() const {
+	if (hasRole("_admin")) return true;
+	const NameRoleSet &admins = securityIndex->admins;
+	if (!userIndex->name.empty() && admins.names.find(userIndex->name) != admins.names.end()) return true;
+	return anyRole(userIndex->roles, admins);
+}
+
+bool ContextData::isMember() const {
+	if (isAdmin()) return true;
+	const NameRoleSet &members = securityIndex->members;
+	if (!userIndex->name.empty() && members.names.find(userIndex->name) != members.names.end()) return true;
+	return anyRole(userIndex->roles, members);
+}
+
+void AbstractProc::log(StrViewA msg, json::Value data) {
+	fn_log(logInfo, String({msg,data.toString()}));
+}
+
+void AbstractProc::start(json::Value headers, int code) {
+	fn_start(Object("code",code)("headers",headers));
+}
+
+void AbstractProc::sendJSON(const json::Value json) {
+	std::string buff;
+	writeJSON(json, buff);
+	fn_send(StrViewA(buff));
+}
+
+void AbstractProc::mapdoc(Document ) {
+	throw std::runtime_error("Function 'void mapdoc(Document)' is not defined");
+}
+Value AbstractProc::reduce(RowSet ) {
+	throw std::runtime_error("Function 'Value reduce(RowSet rows)' is not defined");
+}
+Value AbstractProc::rereduce(Value ) {
+	throw std::runtime_error("Function 'Value rereduce(Value)' is not defined");
+}
+void AbstractProc::show(Document , Value ) {
+	throw std::runtime_error("Function 'void show(Document doc, Value request)' is not defined");
+}
+void AbstractProc::list(Value , Value ) {
+	throw std::runtime_error("Function 'void list(Value head, Value request)' is not defined");
+}
+void AbstractProc::update(Document &, Value ) {
+	throw std::runtime_error("Function 'void update(Document &doc, Value request)' is not defined");
+}
+bool AbstractProc::filter(Document , Value ) {
+	throw std::runtime_error("Function 'bool filter(Document doc, Value request)' is not defined");
+}
+ValidationResult AbstractProc::validate(Document , Context ) {
+	throw std::runtime_error("Function 'ValidationResult validate(Document doc, Context context)' is not defined");
+}
+
+void AbstractProc::onClose() {delete this;}
+
+void AbstractProc::initEmit(EmitFn fn) {fn_emit = fn;}
+void AbstractProc::initLog(LogFn fn) {fn_log = fn;}
+void AbstractProc::initShowListFns(GetRowFn getrow, SendFn send, StartFn start) {
+	this->fn_getRow = getrow;
+	this->fn_send = send;
+	this->fn_start = start;
+}
+
+void AbstractProc::initBodyFns(SendBinaryFn sendBinary, SetBodyFn setJSON) {
+	this->fn_sendBinary = sendBinary;
+	this->fn_setJSONBody = setJSON;
+}
@@ -0,0 +1,240 @@
+/*
+ * schema.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+#include "schema.h"
+
+///Keywords and alternative tokens of C++11
+static const char *keywords[] = {
+		"alignas","alignof","and","and_eq","asm","auto","bitand","bitor","bool","break","case","catch",
+		"char","char16_t","char32_t","class","compl","const","constexpr","const_cast","continue","decltype",
+		"default","delete","do","double","dynamic_cast","else","enum","explicit","export","extern","false",
+		"float","for","friend","goto","if","inline","int","long","mutable","namespace","new","noexcept",
+		"not","not_eq","nullptr","operator","or","or_eq","private","protected","public","register",
+		"reinterpret_cast","return","short","signed","sizeof","static","static_assert","static_cast",
+		"struct","switch","template","this","thread_local","throw","true","try","typedef","typeid",
+		"typename","union","unsigned","using","virtual","void","volatile","wchar_t","while","xor","xor_eq"
+};
+
+///Converts the key to a valid C++ identifier
+/**
+ * Identifiers reserved for the implementation (containing "__", or starting by '_' followed
+ * by an uppercase letter) are avoided too. The sequences of underscores are shortened
+ * and the identifier gets the prefix 'f'
+ */
+static std::string identifier(StrViewA key) {
+	std::string out;
+	for (char c: key) {
+		if (!isalnum((unsigned char)c) && c != '_') c = '_';
+		if (c == '_' && !out.empty() && out.back() == '_') continue;
+		out.push_back(c);
+	}
+	if (out.empty() || isdigit((unsigned char)out[0])) out = "_" + out;
+	else if (out.length() > 1 && out[0] == '_' && isupper((unsigned char)out[1])) out = "f" + out;
+	for (const char *k: keywords) {
+		if (out == k) {
+			out.push_back('_');
+			break;
+		}
+	}
+	return out;
+}
+
+///Assigns unique identifiers to the keys
+/**
+ * Keys, which map to the same identifier (for example "a-b" and "a_b") or to a reserved
+ * name, get the suffix _2, _3, ...
+ */
+class Identifiers {
+public:
+	explicit Identifiers(std::set<std::string> reserved):used(std::move(reserved)) {}
+	std::string make(StrViewA key) {
+		return unique(identifier(key));
+	}
+	std::string unique(std::string base) {
+		//the suffixes can't create "__" (reserved identifier)
+		std::size_t p;
+		while ((p = base.find("__")) != base.npos) base.erase(p, 1);
+		std::string sep = base.back() == '_'?"":"_";
+		std::string out = base;
+		for (unsigned int i = 2; !used.insert(out).second; i++) out = base + sep + std::to_string(i);
+		return out;
+	}
+protected:
+	std::set<std::string> used;
+};
+
+///Writes the key as C++ string literal
+static std::string literal(StrViewA key) {
+	std::string out("\"");
+	for (char c: key) {
+		if (c == '"' || c == '\\') out.push_back('\\');
+		if ((unsigned char)c < 32) {
+			char buff[8];
+			snprintf(buff, sizeof(buff), "\\%03o", (unsigned char)c);
+			out.append(buff);
+		} else {
+			out.push_back(c);
+		}
+	}
+	out.push_back('"');
+	return out;
+}
+
+static void indent(std::ostream &out, unsigned int level) {
+	for (unsigned int i = 0; i < level; i++) out << '\t';
+}
+
+static void writeStruct(std::ostream &out, const std::string &name, Value fields, unsigned int level, bool root);
+
+///Returns true, if the type contains nested structure
+static bool hasStruct(Value type) {
+	switch (type.type()) {
+	case json::object: return true;
+	case json::array: return hasStruct(type[0]);
+	default: return false;
+	}
+}
+
+///Returns C++ type of the field. Nested structures are written to the output
+/**
+ * @param name name of the field
+ * @param typeName name of the nested structure
+ */
+static std::string fieldType(std::ostream &out, const std::string &name, const std::string &typeName, Value type, unsigned int level) {
+	switch (type.type()) {
+	case json::object:
+		writeStruct(out, typeName, type, level, false);
+		return typeName;
+	case json::array:
+		return "std::vector<" + fieldType(out, name, typeName, type[0], level) + ">";
+	default: {
+		StrViewA t = type.getString();
+		if (t == "string") return "StrViewA";
+		if (t == "number") return "double";
+		if (t == "integer") return "std::intptr_t";
+		if (t == "boolean") return "bool";
+		if (t == "any") return "Value";
+		throw std::runtime_error(String({"Schema: unknown type '", type.toString(), "' of the field ", name}).c_str());
+	}
+	}
+}
+
+static std::string defaultValue(Value type) {
+	if (type.type() == json::string) {
+		StrViewA t = type.getString();
+		if (t == "number" || t == "integer") return " = 0";
+		if (t == "boolean") return " = false";
+	}
+	return "";
+}
+
+///Writes code which decodes the value 'src' to the variable 'dest'
+static void writeDecode(std::ostream &out, const std::string &dest, const std::string &src, Value type, unsigned int level) {
+	switch (type.type()) {
+	case json::object:
+		indent(out, level); out << dest << ".decode(" << src << ");\n";
+		break;
+	case json::array: {
+		std::string item = "item" + std::to_string(level);
+		std::string elem = "elem" + std::to_string(level);
+		indent(out, level); out << dest << ".clear();\n";
+		indent(out, level); out << dest << ".reserve(" << src << ".size());\n";
+		indent(out, level); out << "for (Value " << item << ": " << src << ") {\n";
+		indent(out, level+1); out << dest << ".emplace_back();\n";
+		indent(out, level+1); out << "auto &" << elem << " = " << dest << ".back();\n";
+		writeDecode(out, elem, item, type[0], level+1);
+		indent(out, level); out << "}\n";
+		break;
+	}
+	default: {
+		StrViewA t = type.getString();
+		indent(out, level);
+		if (t == "string") out << dest << " = " << src << ".getString();\n";
+		else if (t == "number") out << dest << " = " << src << ".getNumber();\n";
+		else if (t == "integer") out << dest << " = " << src << ".getInt();\n";
+		else if (t == "boolean") out << dest << " = " << src << ".getBool();\n";
+		else out << dest << " = " << src << ";\n";
+	}
+	}
+}
+
+static void writeStruct(std::ostream &out, const std::string &name, Value fields, unsigned int level, bool root) {
+	std::map<std::size_t, std::vector<std::pair<Value, std::string> > > byLength;
+
+	//members can't have the name of the structure, the decoder or the types used by the declarations
+	std::set<std::string> reserved = {name, "decode", "Value", "StrViewA"};
+	if (root) reserved.insert("_document");
+	Identifiers names(reserved);
+	std::vector<std::string> ids;
+	for (Value f: fields) ids.push_back(names.make(f.getKey()));
+
+	indent(out, level); out << "struct " << name << " {\n";
+	if (root) {
+		indent(out, level+1); out << "///The document (keeps strings referenced by the fields)\n";
+		indent(out, level+1); out << "Value _document;\n";
+	}
+	std::size_t idx = 0;
+	for (Value f: fields) {
+		const std::string &id = ids[idx];
+		std::string typeName = hasStruct(f)?names.unique(id + "_t"):std::string();
+		std::string type = fieldType(out, id, typeName, f, level+1);
+		indent(out, level+1); out << type << " " << id << defaultValue(f) << ";\n";
+		byLength[f.getKey().length].push_back(std::make_pair(f, id));
+		idx++;
+	}
+	out << "\n";
+	indent(out, level+1); out << name << "() {}\n";
+	indent(out, level+1); out << name << "(const Value &v) {decode(v);}\n";
+	out << "\n";
+	indent(out, level+1); out << "///Decodes all fields in one pass through the object\n";
+	indent(out, level+1); out << "void decode(const Value &v) {\n";
+	if (root) {
+		indent(out, level+2); out << "_document = v;\n";
+	}
+	indent(out, level+2); out << "for (Value x: v) {\n";
+	indent(out, level+3); out << "StrViewA k = x.getKey();\n";
+	indent(out, level+3); out << "switch (k.length) {\n";
+	for (auto &&l: byLength) {
+		indent(out, level+3); out << "case " << l.first << ":\n";
+		for (auto &&fi: l.second) {
+			Value f = fi.first;
+			indent(out, level+4); out << "if (k == StrViewA(" << literal(f.getKey()) << ")) {\n";
+			//the member is accessed through 'this', because fields can be named as the local variables
+			writeDecode(out, "this->" + fi.second, "x", f, level+5);
+			indent(out, level+5); out << "continue;\n";
+			indent(out, level+4); out << "}\n";
+		}
+		indent(out, level+4); out << "break;\n";
+	}
+	indent(out, level+3); out << "}\n";
+	indent(out, level+2); out << "}\n";
+	indent(out, level+1); out << "}\n";
+	indent(out, level); out << "};\n";
+}
+
+String generateSchemaHeader(Value schema) {
+	std::ostringstream out;
+	out << "//generated by couchcpp from the schema, do not edit\n"
+		   "#pragma once\n"
+		   "#include <vector>\n\n";
+	Identifiers names({"Value", "StrViewA"});
+	for (Value s: schema) {
+		if (s.type() != json::object)
+			throw std::runtime_error(String({"Schema: structure '", s.getKey(), "' must be an object"}).c_str());
+		//names starting by '_' are reserved in the global namespace
+		std::string name = identifier(s.getKey());
+		if (name[0] == '_') name = "S" + name;
+		writeStruct(out, names.unique(name), s, 0, true);
+		out << "\n";
+	}
+	return out.str();
+}
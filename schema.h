@@ -0,0 +1,50 @@
+/*
+ * schema.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Generates C++ header with typed structures from the schema
+/**
+ * The schema is an object, where each key is name of the structure and the value
+ * describes fields of the structure. Each field has a type:
+ *
+ *  - "string" - StrViewA (the text is kept by the document)
+ *  - "number" - double
+ *  - "integer" - std::intptr_t
+ *  - "boolean" - bool
+ *  - "any" - Value
+ *  - {...} - nested structure
+ *  - [type] - std::vector of the type
+ *
+ * @code
+ * {
+ *    "Order": {
+ *         "_id":"string",
+ *         "total":"number",
+ *         "customer":{"name":"string","vip":"boolean"},
+ *         "tags":["string"]
+ *     }
+ * }
+ * @endcode
+ *
+ * Each generated structure has a constructor which accepts the document and decodes all
+ * fields in one pass through the document. Missing fields have default values.
+ *
+ * Keys are converted to C++ identifiers (invalid characters are replaced by '_', keywords get
+ * the suffix '_', "__" is shortened to '_' and "_X" gets the prefix 'f'). When two keys produce
+ * the same identifier (for example "a-b" and "a_b"), or the identifier is reserved (_document,
+ * decode, the name of the structure, Value, StrViewA), the suffix _2, _3, ... is appended.
+ * Nested structures are named by the field with the suffix _t. Names of the structures
+ * starting by '_' get the prefix 'S'.
+ *
+ * @param schema schema
+ * @return source code of the header
+ */
+String generateSchemaHeader(Value schema);
@@ -0,0 +1,235 @@
+/*
+ * selector.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "selector.h"
+
+static void invalidSelector(StrViewA what, StrViewA arg) {
+	throw std::runtime_error(String({"Selector: ", what, " ", arg}).c_str());
+}
+
+///Writes the text as C++ string literal
+static std::string literal(StrViewA text) {
+	std::string out("StrViewA(\"");
+	for (char c: text) {
+		if (c == '"' || c == '\\' || c == '?') out.push_back('\\');
+		if ((unsigned char)c < 32) {
+			char buff[8];
+			snprintf(buff, sizeof(buff), "\\%03o", (unsigned char)c);
+			out.append(buff);
+		} else {
+			out.push_back(c);
+		}
+	}
+	out.append("\",");
+	out.append(std::to_string(text.length));
+	out.push_back(')');
+	return out;
+}
+
+static std::string numberLiteral(Value v) {
+	return "double(" + std::string(v.toString().c_str()) + ")";
+}
+
+///Translates the selector to C++ expression
+class SelectorWriter {
+public:
+	///Returns expression, which is true, when the variable satisfies all conditions of the selector
+	std::string condition(Value sel, const std::string &var);
+	///Returns declarations of the constants used by the expressions
+	std::string constants() const {return consts.str();}
+
+protected:
+	std::ostringstream consts;
+	unsigned int constCount = 0;
+	unsigned int varCount = 0;
+
+	std::string newVar() {return "v" + std::to_string(++varCount);}
+	std::string constant(Value v);
+	std::string fieldAccess(StrViewA path, const std::string &var);
+	std::string fieldCond(Value arg, const std::string &field);
+	std::string equals(Value lit, const std::string &var);
+	std::string compare(Value lit, const std::string &var, const char *op);
+	std::string operatorCond(StrViewA op, Value arg, const std::string &var);
+	std::string list(Value arg, const std::string &var, const char *op, const char *empty);
+};
+
+static std::string join(const std::vector<std::string> &parts, const char *op, const char *empty) {
+	if (parts.empty()) return empty;
+	if (parts.size() == 1) return parts[0];
+	std::string out("(");
+	for (std::size_t i = 0; i < parts.size(); i++) {
+		if (i) out.append(op);
+		out.append(parts[i]);
+	}
+	out.push_back(')');
+	return out;
+}
+
+std::string SelectorWriter::constant(Value v) {
+	std::string name = "c" + std::to_string(++constCount);
+	consts << "const Value " << name << " = Value::fromString(" << literal(v.stringify()) << ");\n";
+	return name;
+}
+
+std::string SelectorWriter::fieldAccess(StrViewA path, const std::string &var) {
+	std::string out = var;
+	std::string key;
+	for (std::size_t i = 0; i <= path.length; i++) {
+		if (i == path.length || path[i] == '.') {
+			out = "fld(" + out + "," + literal(key) + ")";
+			key.clear();
+		} else {
+			//backslash escapes the dot in the name of the field
+			if (path[i] == '\\' && i + 1 < path.length) i++;
+			key.push_back(path[i]);
+		}
+	}
+	return out;
+}
+
+std::string SelectorWriter::fieldCond(Value arg, const std::string &field) {
+	std::string v = newVar();
+	std::string cond = arg.type() == json::object?condition(arg, v):equals(arg, v);
+	return "[&](const Value &" + v + ") {return " + cond + ";}(" + field + ")";
+}
+
+std::string SelectorWriter::equals(Value lit, const std::string &var) {
+	switch (lit.type()) {
+	case json::string:
+		return "(" + var + ".type() == json::string && " + var + ".getString() == " + literal(lit.getString()) + ")";
+	case json::number:
+		return "(" + var + ".type() == json::number && " + var + ".getNumber() == " + numberLiteral(lit) + ")";
+	case json::boolean:
+		return "(" + var + ".type() == json::boolean && " + var + ".getBool() == " + (lit.getBool()?"true":"false") + ")";
+	case json::null:
+		return "(" + var + ".type() == json::null)";
+	default:
+		return "(" + var + " == " + constant(lit) + ")";
+	}
+}
+
+std::string SelectorWriter::compare(Value lit, const std::string &var, const char *op) {
+	switch (lit.type()) {
+	case json::string:
+		return "(" + var + ".type() == json::string && cmpStr(" + var + ".getString(), " + literal(lit.getString()) + ") " + op + " 0)";
+	case json::number:
+		return "(" + var + ".type() == json::number && " + var + ".getNumber() " + op + " " + numberLiteral(lit) + ")";
+	default:
+		invalidSelector("only numbers and strings can be compared:", lit.toString());
+		return std::string();
+	}
+}
+
+std::string SelectorWriter::list(Value arg, const std::string &var, const char *op, const char *empty) {
+	if (arg.type() != json::array) invalidSelector("array expected:", arg.toString());
+	std::vector<std::string> parts;
+	for (Value x: arg) parts.push_back(condition(x, var));
+	return join(parts, op, empty);
+}
+
+std::string SelectorWriter::operatorCond(StrViewA op, Value arg, const std::string &var) {
+	if (op == "$and") return list(arg, var, " && ", "true");
+	if (op == "$or") return list(arg, var, " || ", "false");
+	if (op == "$nor") return "!" + list(arg, var, " || ", "false");
+	if (op == "$not") return "!(" + condition(arg, var) + ")";
+	if (op == "$eq") return equals(arg, var);
+	if (op == "$ne") return "(" + var + ".defined() && !" + equals(arg, var) + ")";
+	if (op == "$gt") return compare(arg, var, ">");
+	if (op == "$gte") return compare(arg, var, ">=");
+	if (op == "$lt") return compare(arg, var, "<");
+	if (op == "$lte") return compare(arg, var, "<=");
+	if (op == "$exists") {
+		if (arg.type() != json::boolean) invalidSelector("$exists expects true or false:", arg.toString());
+		return (arg.getBool()?"":"!") + var + ".defined()";
+	}
+	if (op == "$type") {
+		StrViewA t = arg.getString();
+		if (t != "null" && t != "boolean" && t != "number" && t != "string" && t != "array" && t != "object")
+			invalidSelector("unknown type:", arg.toString());
+		return "(" + var + ".type() == json::" + std::string(t) + ")";
+	}
+	if (op == "$in" || op == "$nin") {
+		if (arg.type() != json::array) invalidSelector("array expected:", arg.toString());
+		std::vector<std::string> parts;
+		for (Value x: arg) parts.push_back(equals(x, var));
+		std::string any = join(parts, " || ", "false");
+		return op == "$in"?any:"(" + var + ".defined() && !" + any + ")";
+	}
+	if (op == "$size") {
+		if (arg.type() != json::number || arg.getNumber() < 0 || arg.getNumber() != (double)arg.getUInt())
+			invalidSelector("$size expects non-negative integer:", arg.toString());
+		return "(" + var + ".type() == json::array && " + var + ".size() == " + std::to_string(arg.getUInt()) + ")";
+	}
+	if (op == "$mod") {
+		if (arg.size() != 2 || arg[0].getIntLong() == 0) invalidSelector("$mod expects [divisor, remainder]:", arg.toString());
+		return "(" + var + ".type() == json::number && " + var + ".getIntLong() % " + std::to_string(arg[0].getIntLong())
+				+ " == " + std::to_string(arg[1].getIntLong()) + ")";
+	}
+	if (op == "$all") {
+		if (arg.type() != json::array) invalidSelector("array expected:", arg.toString());
+		return "hasAll(" + var + ", " + constant(arg) + ")";
+	}
+	if (op == "$elemMatch" || op == "$allMatch") {
+		std::string v = newVar();
+		return std::string(op == "$elemMatch"?"anyOf(":"allOf(") + var + ", [&](const Value &" + v + ") {return "
+				+ condition(arg, v) + ";})";
+	}
+	invalidSelector("unsupported operator:", op);
+	return std::string();
+}
+
+std::string SelectorWriter::condition(Value sel, const std::string &var) {
+	if (sel.type() != json::object) invalidSelector("object expected:", sel.toString());
+	std::vector<std::string> parts;
+	for (Value x: sel) {
+		StrViewA key = x.getKey();
+		if (!key.empty() && key[0] == '$') parts.push_back(operatorCond(key, x, var));
+		else parts.push_back(fieldCond(x, fieldAccess(key, var)));
+	}
+	return join(parts, " && ", "true");
+}
+
+String generateSelectorSource(Value selector) {
+	if (selector["selector"].type() == json::object) selector = selector["selector"];
+	SelectorWriter wr;
+	std::string cond = wr.condition(selector, "doc");
+	std::ostringstream out;
+	//no leading comment: leading "//" lines of the code are passed to the linker (see separateSrc)
+	out << "static Value fld(const Value &v, const StrViewA &k) {return v.type() == json::object?v[k]:Value();}\n"
+		   "static int cmpStr(const StrViewA &a, const StrViewA &b) {\n"
+		   "\tstd::size_t n = a.length < b.length?a.length:b.length;\n"
+		   "\tfor (std::size_t i = 0; i < n; i++) {\n"
+		   "\t\tif (a[i] != b[i]) return (unsigned char)a[i] < (unsigned char)b[i]?-1:1;\n"
+		   "\t}\n"
+		   "\treturn a.length < b.length?-1:(a.length > b.length?1:0);\n"
+		   "}\n"
+		   "template<typename Fn> static bool anyOf(const Value &v, Fn fn) {\n"
+		   "\tif (v.type() != json::array) return false;\n"
+		   "\tfor (Value x: v) if (fn(x)) return true;\n"
+		   "\treturn false;\n"
+		   "}\n"
+		   "template<typename Fn> static bool allOf(const Value &v, Fn fn) {\n"
+		   "\tif (v.type() != json::array) return false;\n"
+		   "\tfor (Value x: v) if (!fn(x)) return false;\n"
+		   "\treturn true;\n"
+		   "}\n"
+		   "static bool hasAll(const Value &v, const Value &items) {\n"
+		   "\tfor (Value i: items) {\n"
+		   "\t\tif (!anyOf(v, [&](const Value &x) {return x == i;})) return false;\n"
+		   "\t}\n"
+		   "\treturn v.type() == json::array;\n"
+		   "}\n"
+		<< wr.constants()
+		<< "virtual bool filter(Document doc, Value) override {\n"
+		   "\treturn " << cond << ";\n"
+		   "}\n";
+	return out.str();
+}
@@ -0,0 +1,39 @@
+/*
+ * selector.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Generates C++ filter function from the declarative selector
+/**
+ * The selector uses the syntax of the Mango selectors. The object at the top level (or
+ * in the field "selector") contains conditions, which all must be satisfied
+ *
+ *  - "field": value - field is equal to value
+ *  - "field": {"$op": arg, ...} - field satisfies the operators
+ *  - "a.b.c" or "a": {"b": {"c": ...}} - nested fields
+ *
+ * Operators: $eq, $ne, $gt, $gte, $lt, $lte, $exists, $type, $in, $nin, $size, $mod, $all,
+ * $elemMatch, $allMatch, and the combinations $and, $or, $nor, $not
+ *
+ * @code
+ * {"type":"user", "age":{"$gte":18}, "$or":[{"role":"admin"},{"tags":{"$all":["beta"]}}]}
+ * @endcode
+ *
+ * The conditions are evaluated in the order of the selector and the evaluation stops at
+ * the first condition, which decides the result.
+ *
+ * Unlike the CouchDB collation, $gt, $gte, $lt and $lte compare strings bytewise (by code points)
+ * and a value of a different type than the argument never matches.
+ *
+ * @param selector selector
+ * @return source code of the class body, which defines the function filter()
+ * @exception std::runtime_error invalid or unsupported selector
+ */
+String generateSelectorSource(Value selector);
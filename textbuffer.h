@@ -0,0 +1,52 @@
+/*
+ * textbuffer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <vector>
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Collects the body of show, list and update responses
+class TextBuffer {
+public:
+	void clear() {
+		outbuffer.clear();
+		binary = false;
+	}
+	String str() const {
+		return StrViewA(outbuffer.data(), outbuffer.size());
+	}
+	void push_back(char c) {
+		outbuffer.push_back(c);
+	}
+	void push_back(StrViewA txt) {
+		outbuffer.reserve(outbuffer.size()+txt.length);
+		for (auto c: txt) outbuffer.push_back(c);
+	}
+	///Appends binary data, the content is no longer text
+	void push_back(BinaryView data) {
+		outbuffer.insert(outbuffer.end(), data.data, data.data+data.length);
+		binary = true;
+	}
+	///Returns content without copying
+	StrViewA view() const {
+		return StrViewA(outbuffer.data(), outbuffer.size());
+	}
+	///Returns true, if binary data were appended
+	bool isBinary() const {
+		return binary;
+	}
+	Value getChunks() const {
+		if (outbuffer.empty()) return Value(json::array);
+		else return Value(json::array,{str()});
+	}
+
+protected:
+	std::vector<char> outbuffer;
+	bool binary = false;
+};
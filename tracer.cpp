@@ -0,0 +1,91 @@
+/*
+ * tracer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#include <unistd.h>
+#include <atomic>
+#include "tracer.h"
+#include "jsonwriter.h"
+#include "module.h"
+
+Tracer *tracer = nullptr;
+
+static thread_local std::string curCommand;
+static std::atomic<unsigned int> nextTid(1);
+static thread_local unsigned int curTid = 0;
+
+Tracer::Tracer(const String &directory, std::size_t maxSize)
+	:directory(directory),maxSize(maxSize),f(nullptr),written(0),pid(0) {}
+
+Tracer::~Tracer() {
+	close();
+}
+
+void Tracer::setCommand(const StrViewA &cmd) {
+	if (tracer) curCommand = cmd;
+}
+
+String Tracer::getPath(const char *suffix) const {
+	return String({directory,"/trace-",Value(pid).toString(),suffix,".json"});
+}
+
+void Tracer::open() {
+	pid = getpid();
+	String path = getPath("");
+	f = std::fopen(path.c_str(), "w");
+	if (f == nullptr) {
+		logOut(logWarning, String({"Unable to create trace: ", path}));
+		return;
+	}
+	written = std::fprintf(f, "[\n");
+}
+
+void Tracer::close() {
+	if (f) {
+		std::fclose(f);
+		f = nullptr;
+	}
+}
+
+void Tracer::record(const char *name, std::size_t hash, std::uint64_t start) {
+	std::uint64_t end = now();
+	if (curTid == 0) curTid = nextTid++;
+
+	std::lock_guard<std::mutex> _(lock);
+	if (pid != getpid()) {
+		//the file of the parent is not continued by the forked worker
+		if (f) std::fclose(f);
+		f = nullptr;
+		open();
+	} else if (written >= maxSize) {
+		close();
+		String cur = getPath("");
+		String old = getPath(".old");
+		rename(cur.c_str(), old.c_str());
+		open();
+	}
+	if (f == nullptr) return;
+
+	char buff[200];
+	line.clear();
+	line.append("{\"name\":\"");
+	line.append(name);
+	snprintf(buff, sizeof(buff), "\",\"cat\":\"couchcpp\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%u,\"args\":{",
+			static_cast<unsigned long long>(start), static_cast<unsigned long long>(end - start), pid, curTid);
+	line.append(buff);
+	line.append("\"cmd\":\"");
+	escapeStringScalar(curCommand, line);
+	line.push_back('"');
+	if (hash) {
+		line.append(",\"module\":\"");
+		String mname = ModuleCompiler::getModuleName(hash);
+		line.append(mname.c_str(), mname.length());
+		line.push_back('"');
+	}
+	line.append("}},\n");
+	written += std::fwrite(line.data(), 1, line.size(), f);
+	std::fflush(f);
+}
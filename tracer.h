@@ -0,0 +1,88 @@
+/*
+ * tracer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ondra
+ */
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <imtjson/json.h>
+
+using namespace json;
+
+///Writes spans to a file in the Chrome trace-event format
+/**
+ * The file can be opened by chrome://tracing or by the Perfetto UI. Each process writes
+ * its own file "trace-<pid>.json". When the file reaches the maximum size, it is renamed to
+ * "trace-<pid>.old.json" (replacing the previous one) and a new file is started
+ *
+ * The object is MT safe
+ */
+class Tracer {
+public:
+	///Creates tracer
+	/**
+	 * @param directory directory where the files are created
+	 * @param maxSize maximum size of single file in bytes
+	 */
+	Tracer(const String &directory, std::size_t maxSize);
+	~Tracer();
+
+	///Records the span
+	/**
+	 * @param name name of the span
+	 * @param hash hash of the module (0 - none)
+	 * @param start start time (see now())
+	 */
+	void record(const char *name, std::size_t hash, std::uint64_t start);
+
+	///Current time in microseconds
+	static std::uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	///Sets the command processed by the current thread. The spans are tagged by the command
+	static void setCommand(const StrViewA &cmd);
+
+protected:
+	std::mutex lock;
+	String directory;
+	std::size_t maxSize;
+	std::FILE *f;
+	std::size_t written;
+	int pid;
+	std::string line;
+
+	void open();
+	void close();
+	String getPath(const char *suffix) const;
+};
+
+///Active tracer, nullptr when tracing is disabled
+extern Tracer *tracer;
+
+///Records duration of the block to the trace
+/**
+ * When tracing is disabled, the object only tests the pointer to the tracer
+ */
+class TraceSpan {
+public:
+	TraceSpan(const char *name, std::size_t hash = 0)
+		:name(name),hash(hash),start(tracer?Tracer::now():0) {}
+	~TraceSpan() {
+		if (start && tracer) tracer->record(name, hash, start);
+	}
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+
+protected:
+	const char *name;
+	std::size_t hash;
+	std::uint64_t start;
+};